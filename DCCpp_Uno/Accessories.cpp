@@ -69,10 +69,12 @@ the directions of any Turnouts being monitored or controlled by a separate inter
 ///////////////////////////////////////////////////////////////////////////////
 
 void Turnout::activate(int s){
-  char c[20];
+  int c[3];
   data.tStatus=(s>0);                                    // if s>0 set turnout=ON, else if zero or negative set turnout=OFF
-  sprintf(c,"a %d %d %d",data.address,data.subAddress,data.tStatus);
-  SerialCommand::parse(c);
+  c[0]=data.address;
+  c[1]=data.subAddress;
+  c[2]=data.tStatus;
+  SerialCommand::mRegs->setAccessory(c,3);
   if(num>0)
     EEPROM.put(num,data.tStatus);
   INTERFACE.print("<H");
@@ -140,11 +142,11 @@ void Turnout::show(int n){
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void Turnout::parse(char *c){
-  int n,s,m;
+void Turnout::parse(int *p, int nParams){
+  int n=p[0],s=p[1],m=p[2];
   Turnout *t;
   
-  switch(sscanf(c,"%d %d %d",&n,&s,&m)){
+  switch(nParams){
     
     case 2:                     // argument is string with id number of turnout followed by zero (not thrown) or one (thrown)
       t=get(n);
@@ -162,7 +164,7 @@ void Turnout::parse(char *c){
       remove(n);
     break;
     
-    case -1:                    // no arguments
+    case 0:                     // no arguments
       show(1);                  // verbose show
     break;
   }
@@ -27,8 +27,10 @@ Part of DCC++ BASE STATION for the Arduino
 
   #endif
 
-  extern EthernetServer INTERFACE;
-#endif  
+  extern EthernetServer COMM_DEVICE;
+#endif
+
+#include "OutputBuffer.h"  
 
 
 
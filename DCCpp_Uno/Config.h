@@ -22,6 +22,33 @@ Part of DCC++ BASE STATION for the Arduino
 
 #define MAX_MAIN_REGISTERS 12
 
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// DEFINE NUMBER OF PREAMBLE BITS SENT BEFORE EACH PACKET
+// (count includes the one bit that also serves as the end bit of the preceding packet)
+//
+//  MAIN: 15-25  (NMRA requires at least 14 preamble bits after the end bit on the operations track)
+//  PROG: 21-25  (NMRA requires at least 20 preamble bits after the end bit in service mode)
+
+#define MAIN_PREAMBLE_BITS 15
+#define PROG_PREAMBLE_BITS 22
+
+/////////////////////////////////////////////////////////////////////////////////////
+//
+// DEFINE DCC BIT TIMING FOR EACH TRACK AS THE DURATION OF EACH HALF OF A BIT, IN MICROSECONDS
+//
+//  ONE BIT:  55-61    (NMRA transmit tolerance; nominal is 58)
+//  ZERO BIT: 95-2000  (NMRA allows up to 9900, but longer zero bits only slow the signal; nominal is 100)
+//
+// Note the Uno generates the Programming Track signal with an 8-bit timer at 4 microsecond resolution, which limits
+// its ZERO bit to at most 500 microseconds per half
+
+#define MAIN_ONE_BIT_HALF_PERIOD   58
+#define MAIN_ZERO_BIT_HALF_PERIOD 100
+
+#define PROG_ONE_BIT_HALF_PERIOD   58
+#define PROG_ZERO_BIT_HALF_PERIOD 100
+
 /////////////////////////////////////////////////////////////////////////////////////
 //
 // DEFINE COMMUNICATIONS INTERFACE
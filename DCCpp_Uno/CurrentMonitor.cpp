@@ -13,10 +13,16 @@ Part of DCC++ BASE STATION for the Arduino
 
 ///////////////////////////////////////////////////////////////////////////////
 
-CurrentMonitor::CurrentMonitor(int pin, char *msg){
+CurrentMonitor::CurrentMonitor(int pin, int enablePin, char *msg, char *name){
     this->pin=pin;
+    this->enablePin=enablePin;
+    channel=(pin==CURRENT_MONITOR_PIN_PROG)?CURRENT_CHANNEL_PROG:CURRENT_CHANNEL_MAIN;
     this->msg=msg;
-    current=0;
+    this->name=name;
+    current.reset(0);
+    tripped=0;
+    retries=0;
+    eventTime=0;
   } // CurrentMonitor::CurrentMonitor
   
 boolean CurrentMonitor::checkTime(){
@@ -25,15 +31,152 @@ boolean CurrentMonitor::checkTime(){
   sampleTime=millis();                                   // note millis() uses TIMER-0.  For UNO, we change the scale on Timer-0.  For MEGA we do not.  This means CURENT_SAMPLE_TIME is different for UNO then MEGA
   return(true);  
 } // CurrentMonitor::checkTime
+
+///////////////////////////////////////////////////////////////////////////////
+
+// EACH CurrentMonitor ONLY CONTROLS THE ENABLE PIN OF ITS OWN TRACK, SO AN OVERLOAD ON THE PROGRAMMING TRACK DOES NOT STOP TRAINS ON THE MAIN
+// TRACK, AND VICE VERSA.  AFTER AN OVERLOAD, POWER IS RESTORED AUTOMATICALLY AFTER CURRENT_RETRY_TIME, WITH THE WAIT DOUBLING AFTER EACH FURTHER
+// OVERLOAD, UP TO CURRENT_RETRY_MAX TIMES.  AFTER THAT, POWER STAYS OFF UNTIL <1> IS SENT.  ONCE POWER HAS STAYED ON FOR CURRENT_RETRY_RESET,
+// THE COUNT STARTS OVER.  POWER IS NEVER RESTORED AUTOMATICALLY AFTER <0>.  EVENTS ARE REPORTED AS:
+//
+//   <p2> or <p3>:           overload on the Main or Programming Track (as before)
+//   <p4 TRACK ATTEMPT>:     power restored automatically to TRACK (MAIN or PROG), where ATTEMPT runs from 1 to CURRENT_RETRY_MAX
+//   <p5 TRACK>:             no more automatic restores --- power to TRACK stays off until <1> is sent
   
 void CurrentMonitor::check(){
-  current=analogRead(pin)*CURRENT_SAMPLE_SMOOTHING+current*(1.0-CURRENT_SAMPLE_SMOOTHING);        // compute new exponentially-smoothed current
-  if(current>CURRENT_SAMPLE_MAX && digitalRead(SIGNAL_ENABLE_PIN_PROG)==HIGH){                    // current overload and Prog Signal is on (or could have checked Main Signal, since both are always on or off together)
-    digitalWrite(SIGNAL_ENABLE_PIN_PROG,LOW);                                                     // disable both Motor Shield Channels
-    digitalWrite(SIGNAL_ENABLE_PIN_MAIN,LOW);                                                     // regardless of which caused current overload
-    INTERFACE.print(msg);                                                                            // print corresponding error message
-  }    
+
+  if(tripped){
+    if(digitalRead(enablePin)==LOW && !CurrentSampler::tripped[channel]){                         // power is still off
+      if(powerOn && retries<CURRENT_RETRY_MAX && millis()-eventTime>=((unsigned long)CURRENT_RETRY_TIME<<retries)){      // time to restore power
+        retries++;
+        tripped=0;
+        eventTime=millis();
+        digitalWrite(enablePin,HIGH);
+        INTERFACE.print("<p4 ");
+        INTERFACE.print(name);
+        INTERFACE.print(" ");
+        INTERFACE.print(retries);
+        INTERFACE.print(">");
+      }
+      return;
+    }
+    tripped=0;                                           // power was turned back on with <1> (and may already have been cut again by a fast trip) --- start count over
+    retries=0;
+    eventTime=millis();
+  }
+
+  if(CurrentSampler::tripped[channel]){                                                          // power was already cut by a fast trip in the ADC interrupt
+    CurrentSampler::tripped[channel]=0;
+    trip();
+  } else if(current.update(CurrentSampler::latest(channel),FILTER_WEIGHT(CURRENT_SAMPLE_SMOOTHING))>CURRENT_SAMPLE_MAX && digitalRead(enablePin)==HIGH){      // current overload and signal is on
+    digitalWrite(enablePin,LOW);                                                                  // disable this track's Motor Shield Channel only
+    trip();
+  } else if(retries>0 && millis()-eventTime>=CURRENT_RETRY_RESET){                                // power has stayed on long enough to start the count over
+    retries=0;
+  }
 } // CurrentMonitor::check  
 
+///////////////////////////////////////////////////////////////////////////////
+
+void CurrentMonitor::trip(){
+  INTERFACE.print(msg);                                  // print corresponding error message
+  tripped=1;
+  eventTime=millis();
+  current.reset(0);                                      // so that samples from before the overload do not trip power again as soon as it is restored
+  if(retries>=CURRENT_RETRY_MAX){
+    INTERFACE.print("<p5 ");
+    INTERFACE.print(name);
+    INTERFACE.print(">");
+  }
+} // CurrentMonitor::trip
+
 long int CurrentMonitor::sampleTime=0;
+byte CurrentMonitor::powerOn=0;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// RATHER THAN WAITING FOR EACH analogRead() TO COMPLETE, THE ADC IS KEPT CONVERTING IN THE BACKGROUND.  EACH TIME A CONVERSION COMPLETES,
+// THE ADC INTERRUPT STORES THE RESULT IN THE RING BUFFER OF ITS TRACK, SWITCHES THE ADC TO THE OTHER TRACK'S PIN, AND STARTS THE NEXT
+// CONVERSION.  THE NEXT CONVERSION IS STARTED FROM THE INTERRUPT, RATHER THAN USING THE ADC'S OWN FREE-RUNNING MODE, SO THAT EACH
+// CONVERSION IS CERTAIN TO USE THE PIN JUST SELECTED.  WITH AN ADC CLOCK OF 250 KHZ, EACH TRACK IS SAMPLED ABOUT EVERY 108 MICROSECONDS.
+
+// OVERCURRENT PROTECTION HAS TWO STAGES.  THE ADC INTERRUPT CHECKS EVERY SAMPLE AS IT ARRIVES, AND CUTS POWER AS SOON AS CURRENT_FAST_TRIP_COUNT
+// SAMPLES IN A ROW EXCEED CURRENT_FAST_TRIP_MAX, SO THAT A DEAD SHORT IS CLEARED IN ABOUT 0.3 MS REGARDLESS OF WHAT loop() IS DOING.  REQUIRING
+// SEVERAL SAMPLES IN A ROW IGNORES THE BRIEF INRUSH WHEN POWER IS TURNED ON.  CurrentMonitor::check() STILL APPLIES THE SLOWER, SMOOTHED
+// CURRENT_SAMPLE_MAX LIMIT TO CATCH SUSTAINED OVERLOADS BELOW THE FAST TRIP LEVEL.
+
+// head[] COUNTS SAMPLES STORED FOR EACH TRACK, AND IS ONLY CHANGED BY THE INTERRUPT.  EACH READER KEEPS ITS OWN COUNT OF SAMPLES READ, SO
+// THE SAME SAMPLES CAN BE READ BY MORE THAN ONE READER.  NOTE analogRead() MUST NOT BE USED ONCE THE SAMPLER IS RUNNING.
+
+void CurrentSampler::init(){
+  mux[CURRENT_CHANNEL_MAIN]=CURRENT_MONITOR_PIN_MAIN-A0;
+  mux[CURRENT_CHANNEL_PROG]=CURRENT_MONITOR_PIN_PROG-A0;
+  channel=CURRENT_CHANNEL_MAIN;
+
+  ADMUX=bit(REFS0) | (mux[channel]&0x07);      // AVcc reference
+#ifdef MUX5
+  bitWrite(ADCSRB,MUX5,bitRead(mux[channel],3));
+#endif
+  ADCSRA=bit(ADEN) | bit(ADIE) | bit(ADPS2) | bit(ADPS1);      // enable ADC and its interrupt with 1:64 prescale (250 KHz ADC clock)
+  bitSet(ADCSRA,ADSC);                                          // start first conversion
+} // CurrentSampler::init
+
+///////////////////////////////////////////////////////////////////////////////
+
+// RETURNS THE NEXT SAMPLE FOR channel AFTER THE ONE COUNTED BY *tail, AND ADVANCES *tail, OR RETURNS -1 IF THERE ARE NO NEW SAMPLES.
+// IF THE READER HAS FALLEN TOO FAR BEHIND, THE SAMPLES ALREADY OVERWRITTEN ARE SKIPPED.
+
+int CurrentSampler::read(byte channel, byte *tail){
+  byte h=head[channel];
+  int v;
+
+  if(h==*tail)
+    return(-1);
+  if((byte)(h-*tail)>CURRENT_SAMPLER_SIZE-1)             // leave the slot that the interrupt will write next alone
+    *tail=h-(CURRENT_SAMPLER_SIZE-1);
+  v=buffer[channel][*tail&(CURRENT_SAMPLER_SIZE-1)];
+  (*tail)++;
+  return(v);
+} // CurrentSampler::read
+
+///////////////////////////////////////////////////////////////////////////////
+
+int CurrentSampler::latest(byte channel){
+  return(buffer[channel][(byte)(head[channel]-1)&(CURRENT_SAMPLER_SIZE-1)]);
+} // CurrentSampler::latest
+
+///////////////////////////////////////////////////////////////////////////////
+
+ISR(ADC_vect){
+  byte ch=CurrentSampler::channel;
+
+  int v=ADC;
+
+  CurrentSampler::buffer[ch][CurrentSampler::head[ch]&(CURRENT_SAMPLER_SIZE-1)]=v;
+  CurrentSampler::head[ch]++;
+
+  if(v<=CURRENT_FAST_TRIP_MAX)                           // fast trip: a short circuit cuts power within a few samples, without waiting for loop()
+    CurrentSampler::tripCount[ch]=0;
+  else if(CurrentSampler::tripCount[ch]<CURRENT_FAST_TRIP_COUNT && ++CurrentSampler::tripCount[ch]==CURRENT_FAST_TRIP_COUNT){
+    digitalWrite(ch==CURRENT_CHANNEL_MAIN?SIGNAL_ENABLE_PIN_MAIN:SIGNAL_ENABLE_PIN_PROG,LOW);      // disable this track's Motor Shield Channel only
+    CurrentSampler::tripped[ch]=1;                       // CurrentMonitor::check() reports the trip
+  }
+
+  ch^=1;                                                 // switch to other track
+  CurrentSampler::channel=ch;
+  ADMUX=bit(REFS0) | (CurrentSampler::mux[ch]&0x07);
+#ifdef MUX5
+  bitWrite(ADCSRB,MUX5,bitRead(CurrentSampler::mux[ch],3));
+#endif
+  bitSet(ADCSRA,ADSC);                                   // start next conversion
+} // ISR(ADC_vect)
+
+///////////////////////////////////////////////////////////////////////////////
+
+volatile int CurrentSampler::buffer[2][CURRENT_SAMPLER_SIZE];
+volatile byte CurrentSampler::head[2]={0,0};
+volatile byte CurrentSampler::channel=CURRENT_CHANNEL_MAIN;
+byte CurrentSampler::mux[2];
+byte CurrentSampler::tripCount[2]={0,0};
+volatile byte CurrentSampler::tripped[2]={0,0};
 
@@ -11,24 +11,64 @@ Part of DCC++ BASE STATION for the Arduino
 #define CurrentMonitor_h
 
 #include "Arduino.h"
+#include "Filter.h"
 
 #define  CURRENT_SAMPLE_SMOOTHING   0.01
 #define  CURRENT_SAMPLE_MAX         300
+#define  CURRENT_FAST_TRIP_MAX      600        // a single unsmoothed sample above this value counts towards a fast trip
+#define  CURRENT_FAST_TRIP_COUNT      3        // number of consecutive samples above CURRENT_FAST_TRIP_MAX that trips power off at once (about 0.3 ms)
+
+#define  CURRENT_RETRY_MAX            5        // number of times power is automatically restored after an overload before waiting for <1>
 
 #ifdef ARDUINO_AVR_UNO                        // Configuration for UNO
   #define  CURRENT_SAMPLE_TIME        10
+  #define  CURRENT_RETRY_TIME        700        // wait before first automatic restore of power (~100 ms, since millis() runs fast when TIMER-0 is used for the Programming Track), doubled on each retry
+  #define  CURRENT_RETRY_RESET     35000        // time power must stay on before the retry count starts over (~5 seconds)
 #else                                         // Configuration for MEGA    
   #define  CURRENT_SAMPLE_TIME        1
+  #define  CURRENT_RETRY_TIME        100        // wait before first automatic restore of power, in milliseconds, doubled on each retry
+  #define  CURRENT_RETRY_RESET      5000        // time power must stay on before the retry count starts over, in milliseconds
 #endif
 
+// Define the ring buffers of current samples collected by the ADC interrupt, alternating between the Main and Programming Tracks
+
+#define  CURRENT_CHANNEL_MAIN       0
+#define  CURRENT_CHANNEL_PROG       1
+
+#ifdef ARDUINO_AVR_UNO                        // Configuration for UNO
+  #define  CURRENT_SAMPLER_SIZE     32        // number of samples kept for each track (must be a power of 2), enough for a pass through loop() of up to 3.4 ms
+#else                                         // Configuration for MEGA    
+  #define  CURRENT_SAMPLER_SIZE    128        // enough for a pass through loop() of up to 13.8 ms, including a wait for a full update queue
+#endif
+
+struct CurrentSampler{
+  static volatile int buffer[2][CURRENT_SAMPLER_SIZE];
+  static volatile byte head[2];
+  static volatile byte channel;
+  static byte mux[2];
+  static byte tripCount[2];
+  static volatile byte tripped[2];
+  static void init();
+  static int read(byte, byte *);
+  static int latest(byte);
+};
+
 struct CurrentMonitor{
   static long int sampleTime;
+  static byte powerOn;              // set by <1> and cleared by <0>, so that power is not restored automatically after <0>
   int pin;
-  float current;
+  int enablePin;
+  byte channel;
+  ExpFilter current;
   char *msg;
-  CurrentMonitor(int, char *);
+  char *name;
+  byte tripped;                     // set while power is off following an overload
+  byte retries;                     // number of automatic restores of power since the last reset of the count
+  unsigned long eventTime;          // time of the last overload, or of the last restore of power
+  CurrentMonitor(int, int, char *, char *);
   static boolean checkTime();
   void check();
+  void trip();
 };
 
 #endif
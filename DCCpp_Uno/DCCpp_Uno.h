@@ -52,6 +52,30 @@ Part of DCC++ BASE STATION for the Arduino
 
 #endif
 
+/////////////////////////////////////////////////////////////////////////////////////
+// CHECK PREAMBLE LENGTHS AND BIT TIMING
+/////////////////////////////////////////////////////////////////////////////////////
+
+#if MAIN_PREAMBLE_BITS < 15 || MAIN_PREAMBLE_BITS > 25
+  #error CANNOT COMPILE - MAIN_PREAMBLE_BITS MUST BE BETWEEN 15 AND 25 - PLEASE CHECK THE CONFIG FILE
+#endif
+
+#if PROG_PREAMBLE_BITS < 21 || PROG_PREAMBLE_BITS > 25
+  #error CANNOT COMPILE - PROG_PREAMBLE_BITS MUST BE BETWEEN 21 AND 25 - PLEASE CHECK THE CONFIG FILE
+#endif
+
+#if MAIN_ONE_BIT_HALF_PERIOD < 55 || MAIN_ONE_BIT_HALF_PERIOD > 61 || PROG_ONE_BIT_HALF_PERIOD < 55 || PROG_ONE_BIT_HALF_PERIOD > 61
+  #error CANNOT COMPILE - ONE BIT HALF PERIODS MUST BE BETWEEN 55 AND 61 MICROSECONDS - PLEASE CHECK THE CONFIG FILE
+#endif
+
+#if MAIN_ZERO_BIT_HALF_PERIOD < 95 || MAIN_ZERO_BIT_HALF_PERIOD > 2000 || PROG_ZERO_BIT_HALF_PERIOD < 95 || PROG_ZERO_BIT_HALF_PERIOD > 2000
+  #error CANNOT COMPILE - ZERO BIT HALF PERIODS MUST BE BETWEEN 95 AND 2000 MICROSECONDS - PLEASE CHECK THE CONFIG FILE
+#endif
+
+#if defined ARDUINO_AVR_UNO && PROG_ZERO_BIT_HALF_PERIOD > 500
+  #error CANNOT COMPILE - PROG_ZERO_BIT_HALF_PERIOD CANNOT EXCEED 500 MICROSECONDS ON THE UNO - PLEASE CHECK THE CONFIG FILE
+#endif
+
 /////////////////////////////////////////////////////////////////////////////////////
 // SELECT MOTOR SHIELD
 /////////////////////////////////////////////////////////////////////////////////////
@@ -95,12 +119,12 @@ Part of DCC++ BASE STATION for the Arduino
 #if COMM_INTERFACE == 0
 
   #define COMM_TYPE 0
-  #define INTERFACE Serial
+  #define COMM_DEVICE Serial
 
 #elif (COMM_INTERFACE==1) || (COMM_INTERFACE==2) || (COMM_INTERFACE==3)
 
   #define COMM_TYPE 1
-  #define INTERFACE eServer
+  #define COMM_DEVICE eServer
   #define SDCARD_CS 4
   
 #else
@@ -109,6 +133,10 @@ Part of DCC++ BASE STATION for the Arduino
 
 #endif
 
+// RESPONSES ARE PRINTED TO INTERFACE, WHICH STORES THEM UNTIL THEY CAN BE SENT TO COMM_DEVICE WITHOUT WAITING (SEE OutputBuffer.cpp)
+
+#define INTERFACE outputBuffer
+
 /////////////////////////////////////////////////////////////////////////////////////
 // SET WHETHER TO SHOW PACKETS - DIAGNOSTIC MODE ONLY
 /////////////////////////////////////////////////////////////////////////////////////
@@ -128,6 +156,28 @@ Part of DCC++ BASE STATION for the Arduino
  
 #define SHOW_PACKETS  0       // set to zero to disable printing of every packet for select main operations track commands
 
+/////////////////////////////////////////////////////////////////////////////////////
+// SET WHETHER TO TIME THE DCC SIGNAL INTERRUPTS - DIAGNOSTIC MODE ONLY
+/////////////////////////////////////////////////////////////////////////////////////
+
+// If ISR_TIMING is set to 1, the Main Track and Programming Track interrupt routines record how long each call takes, how late
+// after its compare-match each call started, and whether the timer had already passed the end of the bit before the next bit
+// was loaded (which stretches a bit on the track).  The results are returned by the <I> command in the following format:
+
+//    <I TRACK COUNT MIN AVG MAX LATENCY LATE H0 H1 ... H7>
+//
+//    TRACK: MAIN or PROG
+//    COUNT: the number of interrupts timed since the last <I> command
+//    MIN, AVG, MAX: the minimum, average, and maximum time, in CPU cycles, from the start to the end of the DCC signal logic
+//    LATENCY: the maximum time, in CPU cycles, from the compare-match to the start of the DCC signal logic
+//    LATE: the number of interrupts that completed after the timer wrapped, i.e. a DCC bit was stretched
+//    H0-H7: histogram of times in 32-cycle (2 microsecond) buckets, with H7 counting all times of 224 cycles or more
+//
+// Times exclude the compiler-generated entry and exit code of the interrupt.  On the Uno the Programming Track timer
+// counts in steps of 64 cycles, so its times are only accurate to 64 cycles.  Timing adds a few microseconds to every interrupt.
+
+#define ISR_TIMING  0         // set to zero to disable timing of the DCC signal interrupts
+
 /////////////////////////////////////////////////////////////////////////////////////
 
 #endif
@@ -38,6 +38,7 @@ This version of DCC++ BASE STATION supports:
   * Programming on the Main Operations Track
       - write configuration variable bytes
       - set/clear specific configuration variable bits
+  * Advanced consists driven through a single throttle register
   * Programming on the Programming Track
       - write configuration variable bytes
       - set/clear specific configuration variable bits
@@ -102,11 +103,15 @@ that has been loaded with a throttle control setting for a given cab.  For each
 transmits the appropriate DCC packet bits to the track, then moves onto the next register
 without any pausing to ensure continuous bi-polar power is being provided to the tracks.
 Updates to the throttle setting stored in any given packet register are done in a double-buffered
-fashion and the sequencer is pointed to that register immediately after being changes so that updated DCC bits
+fashion: each update is built in a spare packet held in a small queue of pending updates, and the sequencer
+swaps that packet into the register and points to it as soon as the current packet completes, so that updated DCC bits
 can be transmitted to the appropriate cab without delay or any interruption in the bi-polar power signal.
+Several updates can wait in the queue at once, so bursts of commands do not stall the main loop.
 The cabs identified in each stored throttle setting should be unique across registers.  If two registers
 contain throttle setting for the same cab, the throttle in the engine will oscillate between the two,
-which is probably not a desireable outcome.
+which is probably not a desireable outcome.  Alternatively, throttle commands may give only the cab, in which case
+DCC++ BASE STATION selects the register itself, re-using the register already holding that cab, and when all registers
+are in use, taking over the register of the stopped cab that was least recently commanded.
 
 For both the main operations track and the programming track there is also a special packet register with id=0
 that is used to store all other DCC packets that do not require continious transmittal to the tracks.
@@ -149,7 +154,8 @@ DCC++ BASE STATION in split into multiple modules, each with its own header file
 
   CurrentMonitor:   contains methods to separately monitor and report the current drawn from CHANNEL A and
                     CHANNEL B of the Arduino Motor Shield's, and shut down power if a short-circuit overload
-                    is detected
+                    is detected.  Also contains the interrupt-driven CurrentSampler that collects current samples for
+                    both tracks in the background
 
   Accessories:      contains methods to operate and store the status of any optionally-defined turnouts controlled
                     by a DCC stationary accessory decoder.
@@ -162,6 +168,9 @@ DCC++ BASE STATION in split into multiple modules, each with its own header file
   EEStore:          contains methods to store, update, and load various DCC settings and status
                     (e.g. the states of all defined turnouts) in the EEPROM for recall after power-up
 
+  OutputBuffer:     holds responses printed to the serial line or network until they can be sent without
+                    waiting, and sends them in as few writes as possible
+
 DCC++ BASE STATION is configured through the Config.h file that contains all user-definable parameters                    
 
 **********************************************************************/
@@ -184,17 +193,24 @@ void showConfiguration();
 
 #if COMM_TYPE == 1
   byte mac[] =  MAC_ADDRESS;                                // Create MAC address (to be used for DHCP when initializing server)
-  EthernetServer INTERFACE(ETHERNET_PORT);                  // Create and instance of an EnternetServer
+  EthernetServer COMM_DEVICE(ETHERNET_PORT);                // Create and instance of an EnternetServer
 #endif
 
+OutputBuffer outputBuffer;                                  // holds responses until they can be sent without waiting
+
 // NEXT DECLARE GLOBAL OBJECTS TO PROCESS AND STORE DCC PACKETS AND MONITOR TRACK CURRENTS.
 // NOTE REGISTER LISTS MUST BE DECLARED WITH "VOLATILE" QUALIFIER TO ENSURE THEY ARE PROPERLY UPDATED BY INTERRUPT ROUTINES
 
-volatile RegisterList mainRegs(MAX_MAIN_REGISTERS);    // create list of registers for MAX_MAIN_REGISTER Main Track Packets
-volatile RegisterList progRegs(2);                     // create a shorter list of only two registers for Program Track Packets
+volatile RegisterList mainRegs(MAX_MAIN_REGISTERS,MAIN_UPDATE_QUEUE_SIZE,MAIN_PREAMBLE_BITS,MAX_CONSIST_MEMBERS);    // create list of registers for MAX_MAIN_REGISTER Main Track Packets, with a table of advanced consist members
+volatile RegisterList progRegs(2,PROG_UPDATE_QUEUE_SIZE,PROG_PREAMBLE_BITS);                   // create a shorter list of only two registers for Program Track Packets (no consists are formed there)
+
+#if ISR_TIMING == 1
+  IsrTiming mainTiming;                                // interrupt timing statistics for Main Track
+  IsrTiming progTiming;                                // interrupt timing statistics for Program Track
+#endif
 
-CurrentMonitor mainMonitor(CURRENT_MONITOR_PIN_MAIN,"<p2>");  // create monitor for current on Main Track
-CurrentMonitor progMonitor(CURRENT_MONITOR_PIN_PROG,"<p3>");  // create monitor for current on Program Track
+CurrentMonitor mainMonitor(CURRENT_MONITOR_PIN_MAIN,SIGNAL_ENABLE_PIN_MAIN,"<p2>","MAIN");  // create monitor for current on Main Track
+CurrentMonitor progMonitor(CURRENT_MONITOR_PIN_PROG,SIGNAL_ENABLE_PIN_PROG,"<p3>","PROG");  // create monitor for current on Program Track
 
 ///////////////////////////////////////////////////////////////////////////////
 // MAIN ARDUINO LOOP
@@ -203,6 +219,10 @@ CurrentMonitor progMonitor(CURRENT_MONITOR_PIN_PROG,"<p3>");  // create monitor
 void loop(){
   
   SerialCommand::process();              // check for, and process, and new serial commands
+
+  mainRegs.refreshFunctions();           // re-send next stored cab function group, if due
+
+  progRegs.processCV();                  // advance any CV read or write in progress on the Programming Track
   
   if(CurrentMonitor::checkTime()){      // if sufficient time has elapsed since last update, check current draw on Main and Program Tracks 
     mainMonitor.check();
@@ -210,6 +230,8 @@ void loop(){
   }
 
   Sensor::check();    // check sensors for activate/de-activate
+
+  outputBuffer.drain();                  // send any complete responses the interface has room for
   
 } // loop
 
@@ -229,6 +251,8 @@ void setup(){
 
   EEStore::init();                                          // initialize and load Turnout and Sensor definitions stored in EEPROM
 
+  CurrentSampler::init();                                   // start sampling current on Main and Program Tracks in the background
+
   pinMode(A5,INPUT);                                       // if pin A5 is grounded upon start-up, print system configuration and halt
   digitalWrite(A5,HIGH);
   if(!digitalRead(A5))
@@ -252,7 +276,7 @@ void setup(){
     #else
       Ethernet.begin(mac);                      // Start networking using DHCP to get an IP Address
     #endif
-    INTERFACE.begin();
+    COMM_DEVICE.begin();
   #endif
              
   SerialCommand::init(&mainRegs, &progRegs, &mainMonitor);   // create structure to read and parse commands from serial line
@@ -272,14 +296,15 @@ void setup(){
   
   // Direction Pin for Motor Shield Channel A - MAIN OPERATIONS TRACK
   // Controlled by Arduino 16-bit TIMER 1 / OC1B Interrupt Pin
-  // Values for 16-bit OCR1A and OCR1B registers calibrated for 1:1 prescale at 16 MHz clock frequency
-  // Resulting waveforms are 200 microseconds for a ZERO bit and 116 microseconds for a ONE bit with exactly 50% duty cycle
+  // Values for 16-bit OCR1A and OCR1B registers calibrated for 1:1 prescale at 16 MHz clock frequency (16 counts per microsecond)
+  // Resulting waveforms are 2 x MAIN_ZERO_BIT_HALF_PERIOD microseconds for a ZERO bit and 2 x MAIN_ONE_BIT_HALF_PERIOD microseconds for a ONE bit
+  // with exactly 50% duty cycle (200 and 116 microseconds by default)
 
-  #define DCC_ZERO_BIT_TOTAL_DURATION_TIMER1 3199
-  #define DCC_ZERO_BIT_PULSE_DURATION_TIMER1 1599
+  #define DCC_ZERO_BIT_TOTAL_DURATION_TIMER1 (MAIN_ZERO_BIT_HALF_PERIOD*32-1)
+  #define DCC_ZERO_BIT_PULSE_DURATION_TIMER1 (MAIN_ZERO_BIT_HALF_PERIOD*16-1)
 
-  #define DCC_ONE_BIT_TOTAL_DURATION_TIMER1 1855
-  #define DCC_ONE_BIT_PULSE_DURATION_TIMER1 927
+  #define DCC_ONE_BIT_TOTAL_DURATION_TIMER1 (MAIN_ONE_BIT_HALF_PERIOD*32-1)
+  #define DCC_ONE_BIT_PULSE_DURATION_TIMER1 (MAIN_ONE_BIT_HALF_PERIOD*16-1)
 
   pinMode(DIRECTION_MOTOR_CHANNEL_PIN_A,INPUT);      // ensure this pin is not active! Direction will be controlled by DCC SIGNAL instead (below)
   digitalWrite(DIRECTION_MOTOR_CHANNEL_PIN_A,LOW);
@@ -313,14 +338,15 @@ void setup(){
   
   // Directon Pin for Motor Shield Channel B - PROGRAMMING TRACK
   // Controlled by Arduino 8-bit TIMER 0 / OC0B Interrupt Pin
-  // Values for 8-bit OCR0A and OCR0B registers calibrated for 1:64 prescale at 16 MHz clock frequency
-  // Resulting waveforms are 200 microseconds for a ZERO bit and 116 microseconds for a ONE bit with as-close-as-possible to 50% duty cycle
+  // Values for 8-bit OCR0A and OCR0B registers calibrated for 1:64 prescale at 16 MHz clock frequency (one count per 4 microseconds, rounded to nearest)
+  // Resulting waveforms are 2 x PROG_ZERO_BIT_HALF_PERIOD microseconds for a ZERO bit and 2 x PROG_ONE_BIT_HALF_PERIOD microseconds for a ONE bit
+  // with as-close-as-possible to 50% duty cycle (200 and 116 microseconds by default)
 
-  #define DCC_ZERO_BIT_TOTAL_DURATION_TIMER0 49
-  #define DCC_ZERO_BIT_PULSE_DURATION_TIMER0 24
+  #define DCC_ZERO_BIT_TOTAL_DURATION_TIMER0 ((PROG_ZERO_BIT_HALF_PERIOD*2+2)/4-1)
+  #define DCC_ZERO_BIT_PULSE_DURATION_TIMER0 ((PROG_ZERO_BIT_HALF_PERIOD+2)/4-1)
 
-  #define DCC_ONE_BIT_TOTAL_DURATION_TIMER0 28
-  #define DCC_ONE_BIT_PULSE_DURATION_TIMER0 14
+  #define DCC_ONE_BIT_TOTAL_DURATION_TIMER0 ((PROG_ONE_BIT_HALF_PERIOD*2+2)/4-1)
+  #define DCC_ONE_BIT_PULSE_DURATION_TIMER0 ((PROG_ONE_BIT_HALF_PERIOD+2)/4-1)
   
   pinMode(DIRECTION_MOTOR_CHANNEL_PIN_B,INPUT);      // ensure this pin is not active! Direction will be controlled by DCC SIGNAL instead (below)
   digitalWrite(DIRECTION_MOTOR_CHANNEL_PIN_B,LOW);
@@ -351,14 +377,15 @@ void setup(){
 
   // Directon Pin for Motor Shield Channel B - PROGRAMMING TRACK
   // Controlled by Arduino 16-bit TIMER 3 / OC3B Interrupt Pin
-  // Values for 16-bit OCR3A and OCR3B registers calibrated for 1:1 prescale at 16 MHz clock frequency
-  // Resulting waveforms are 200 microseconds for a ZERO bit and 116 microseconds for a ONE bit with exactly 50% duty cycle
+  // Values for 16-bit OCR3A and OCR3B registers calibrated for 1:1 prescale at 16 MHz clock frequency (16 counts per microsecond)
+  // Resulting waveforms are 2 x PROG_ZERO_BIT_HALF_PERIOD microseconds for a ZERO bit and 2 x PROG_ONE_BIT_HALF_PERIOD microseconds for a ONE bit
+  // with exactly 50% duty cycle (200 and 116 microseconds by default)
 
-  #define DCC_ZERO_BIT_TOTAL_DURATION_TIMER3 3199
-  #define DCC_ZERO_BIT_PULSE_DURATION_TIMER3 1599
+  #define DCC_ZERO_BIT_TOTAL_DURATION_TIMER3 (PROG_ZERO_BIT_HALF_PERIOD*32-1)
+  #define DCC_ZERO_BIT_PULSE_DURATION_TIMER3 (PROG_ZERO_BIT_HALF_PERIOD*16-1)
 
-  #define DCC_ONE_BIT_TOTAL_DURATION_TIMER3 1855
-  #define DCC_ONE_BIT_PULSE_DURATION_TIMER3 927
+  #define DCC_ONE_BIT_TOTAL_DURATION_TIMER3 (PROG_ONE_BIT_HALF_PERIOD*32-1)
+  #define DCC_ONE_BIT_PULSE_DURATION_TIMER3 (PROG_ONE_BIT_HALF_PERIOD*16-1)
 
   pinMode(DIRECTION_MOTOR_CHANNEL_PIN_B,INPUT);      // ensure this pin is not active! Direction will be controlled by DCC SIGNAL instead (below)
   digitalWrite(DIRECTION_MOTOR_CHANNEL_PIN_B,LOW);
@@ -417,30 +444,94 @@ void setup(){
 // that can be invoked with proper paramters for each interrupt.  This slightly increases the size of the code base by duplicating
 // some of the logic for each interrupt, but saves additional time.
 
+// Packet bits are stored most-significant-bit first, so once a Packet is selected the interrupt code simply walks a byte pointer
+// and a shifting one-bit mask through its buffer.  Each bit therefore costs one load, one AND, and one shift --- no bit-index
+// division or modulo, no lookup table, and no dereferencing of currentReg->activePacket except once per Packet.
+
 // As structured, the interrupt code below completes at an average of just under 6 microseconds with a worse-case of just under 11 microseconds
-// when a new register is loaded and the logic needs to switch active register packet pointers.
+// when a new register is loaded and the logic needs to switch active register packet pointers.  Taking an update from the queue
+// of pending updates is the same pointer swap plus a one-byte advance of the queue tail, so the worst case stays within this budget ---
+// any searching of the queue is done by loadPacket() in the main loop, never here.
+
+// Packets are scheduled in three tiers: first any update waiting in the queue, which is sent as soon as the current packet completes;
+// then newly-changed permanent Registers, each re-sent PRIORITY_REFRESH_COUNT more times in turn; and finally the background refresh cycle
+// through all loaded Registers.  A changed speed therefore reaches the decoder within one or two packet times rather than after a full
+// refresh cycle.  Each tier is a constant-time step, so the worst case above is only lengthened by a few pointer moves.
+
+// So that a steady stream of throttle changes can never starve the background refresh cycle, at most PRIORITY_BURST_MAX packets in a row
+// are sent for newly-changed permanent Registers (from the queue or the priority list) before one packet of the refresh cycle is sent in
+// between.  With n Registers loaded, each is therefore refreshed at least once every n x (PRIORITY_BURST_MAX+1) packets, not counting
+// one-time packets in Register 0, which are never held back (service-mode sequences on the Programming Track must not be broken up).
+// Since the queue can be held back while the refresh cycle runs, a Register only joins the refresh cycle once its first Packet has been
+// taken from the queue; until then it has no Packet to send.
+
+// Ahead of all three tiers, an emergency stop requested with <!> takes over at the next packet boundary: the interrupt code sends only
+// the emergency stop packet until the Registers have been re-written to stop, and then ESTOP_REPEAT_COUNT more times.  A one-time packet
+// in Register 0 that was still being repeated (an operations-mode CV write, for example) is not lost: its remaining repeats are sent right
+// after the emergency stop packets, and any one-time packets still in the queue follow in order.
+
+// At each packet boundary the interrupt code also counts the packet, and records for the Register being sent how many packets
+// have gone by since it was last sent.  This is the only telemetry kept in the interrupt, and it is done once per packet, not per bit.
 
 // THE INTERRUPT CODE MACRO:  R=REGISTER LIST (mainRegs or progRegs), and N=TIMER (0 or 1)
 
 #define DCC_SIGNAL(R,N) \
-  if(R.currentBit==R.currentReg->activePacket->nBits){    /* IF no more bits in this DCC Packet */ \
-    R.currentBit=0;                                       /*   reset current bit pointer and determine which Register and Packet to process next--- */ \   
-    if(R.nRepeat>0 && R.currentReg==R.reg){               /*   IF current Register is first Register AND should be repeated */ \
+  if(R.bitsLeft==0){                                      /* IF no more bits in this DCC Packet */ \
+                                                          /*   determine which Register and Packet to process next--- */ \
+    if(R.nStop>0){                                        /*   IF an emergency stop is in progress */ \
+      R.nStop--;                                          /*     decrement stop count and send the emergency stop packet ahead of everything else */ \
+      R.currentReg=R.stopReg; \
+    } else if(R.nRepeat>0){                               /*   ELSE IF the one-time Packet in the first Register should be repeated (also after an emergency stop cut in) */ \
       R.nRepeat--;                                        /*     decrement repeat count; result is this same Packet will be repeated */ \
-    } else if(R.nextReg!=NULL){                           /*   ELSE IF another Register has been updated */ \
-      R.currentReg=R.nextReg;                             /*     update currentReg to nextReg */ \
-      R.nextReg=NULL;                                     /*     reset nextReg to NULL */ \
-      R.tempPacket=R.currentReg->activePacket;            /*     flip active and update Packets */ \        
-      R.currentReg->activePacket=R.currentReg->updatePacket; \
-      R.currentReg->updatePacket=R.tempPacket; \
-    } else{                                               /*   ELSE simply move to next Register */ \
-      if(R.currentReg==R.maxLoadedReg)                    /*     BUT IF this is last Register loaded */ \
-        R.currentReg=R.reg;                               /*       first reset currentReg to base Register, THEN */ \
-      R.currentReg++;                                     /*     increment current Register (note this logic causes Register[0] to be skipped when simply cycling through all Registers) */ \
+      R.currentReg=R.reg; \
+    } else if(R.queueTail!=R.queueHead && (R.nBurst<PRIORITY_BURST_MAX || R.updateQueue[R.queueTail].reg==R.reg)){   /*   ELSE IF an update is waiting in the queue, and either the refresh cycle is not being held off too long or it is a one-time Packet */ \
+      R.currentReg=R.updateQueue[R.queueTail].reg;        /*     update currentReg to the Register in the oldest queue slot */ \
+      R.tempPacket=R.currentReg->activePacket;            /*     swap active Packet with the Packet in the queue slot */ \
+      R.currentReg->activePacket=R.updateQueue[R.queueTail].packet; \
+      R.updateQueue[R.queueTail].packet=R.tempPacket; \
+      if(R.currentReg==R.reg){                            /*     IF this is the first Register */ \
+        R.nRepeat=R.updateQueue[R.queueTail].nRepeat;     /*       set number of repeats for this one-time Packet */ \
+      } else{                                             /*     ELSE this is a newly-changed permanent Register */ \
+        R.nBurst++;                                       /*       which holds off the refresh cycle for one more packet */ \
+        if(R.currentReg>R.maxLoadedReg)                   /*       IF this is the Register's first Packet */ \
+          R.maxLoadedReg=R.currentReg;                    /*         add it to the background refresh cycle only now that it has a Packet to send */ \
+        if(R.currentReg->nPriority==0){                   /*       IF not already in the priority list */ \
+          R.priorityRegs[R.priorityHead]=R.currentReg;    /*         add it */ \
+          R.priorityHead=(R.priorityHead==R.maxNumRegs)?0:R.priorityHead+1; \
+        }                                                 /*       END-IF */ \
+        R.currentReg->nPriority=R.updateQueue[R.queueTail].nRepeat;   /*       set number of times it will be re-sent ahead of the background refresh */ \
+      }                                                   /*     END-ELSE */ \
+      R.queueTail=(R.queueTail==R.queueSize)?0:R.queueTail+1;     /*     remove update from queue */ \
+    } else if(R.priorityTail!=R.priorityHead && R.nBurst<PRIORITY_BURST_MAX){   /*   ELSE IF a newly-changed Register still needs to be re-sent, and the refresh cycle is not being held off too long */ \
+      R.nBurst++;                                         /*     which holds off the refresh cycle for one more packet */ \
+      R.currentReg=R.priorityRegs[R.priorityTail];        /*     update currentReg to the oldest Register in the priority list */ \
+      R.priorityTail=(R.priorityTail==R.maxNumRegs)?0:R.priorityTail+1; \
+      if(--R.currentReg->nPriority>0){                    /*     IF it must be re-sent again */ \
+        R.priorityRegs[R.priorityHead]=R.currentReg;      /*       move it to the back of the priority list so that newly-changed Registers take turns */ \
+        R.priorityHead=(R.priorityHead==R.maxNumRegs)?0:R.priorityHead+1; \
+      }                                                   /*     END-IF */ \
+    } else{                                               /*   ELSE simply move to next Register in the background refresh cycle */ \
+      R.nBurst=0;                                         /*     the refresh cycle is no longer being held off */ \
+      if(R.refreshReg==R.maxLoadedReg)                    /*     BUT IF this is last Register loaded */ \
+        R.refreshReg=R.reg;                               /*       first reset refreshReg to base Register, THEN */ \
+      R.refreshReg++;                                     /*     increment refresh Register (note this logic causes Register[0] to be skipped when simply cycling through all Registers) */ \
+      R.currentReg=R.refreshReg;                          /*     the refresh cycle keeps its own place so that priority re-sends do not cause other Registers to be skipped */ \
     }                                                     /*   END-ELSE */ \
-  }                                                       /* END-IF: currentReg, activePacket, and currentBit should now be properly set to point to next DCC bit */ \
+    R.packetCount++;                                      /*   update telemetry */ \
+    if(R.currentReg==R.reg){                              /*   IF this is a one-time Packet it has pre-empted the refresh cycle */ \
+      R.oneShotCount++; \
+    } else{                                               /*   ELSE record the refresh interval of this Register */ \
+      R.currentReg->lastInterval=(unsigned int)R.packetCount-R.currentReg->lastSent; \
+      R.currentReg->lastSent=R.packetCount; \
+      if(R.currentReg->lastInterval>R.currentReg->maxInterval) \
+        R.currentReg->maxInterval=R.currentReg->lastInterval; \
+    }                                                     /*   END-ELSE */ \
+    R.currentByte=R.currentReg->activePacket->buf;        /*   point to first byte of the Packet to be sent */ \
+    R.currentMask=0x80;                                   /*   starting with its most significant bit */ \
+    R.bitsLeft=R.currentReg->activePacket->nBits;         /*   and set the number of bits to be sent */ \
+  }                                                       /* END-IF: currentByte, currentMask, and bitsLeft should now be properly set to point to next DCC bit */ \
                                                           \
-  if(R.currentReg->activePacket->buf[R.currentBit/8] & R.bitMask[R.currentBit%8]){     /* IF bit is a ONE */ \
+  if(*R.currentByte & R.currentMask){                                                  /* IF bit is a ONE */ \
     OCR ## N ## A=DCC_ONE_BIT_TOTAL_DURATION_TIMER ## N;                               /*   set OCRA for timer N to full cycle duration of DCC ONE bit */ \
     OCR ## N ## B=DCC_ONE_BIT_PULSE_DURATION_TIMER ## N;                               /*   set OCRB for timer N to half cycle duration of DCC ONE but */ \
   } else{                                                                              /* ELSE it is a ZERO */ \
@@ -448,26 +539,67 @@ void setup(){
     OCR ## N ## B=DCC_ZERO_BIT_PULSE_DURATION_TIMER ## N;                              /*   set OCRB for timer N to half cycle duration of DCC ZERO bit */ \
   }                                                                                    /* END-ELSE */ \ 
                                                                                        \ 
-  R.currentBit++;                                         /* point to next bit in current Packet */  
+  R.bitsLeft--;                                           /* point to next bit in current Packet */ \
+  R.currentMask>>=1;                                      /*   by shifting the mask one bit to the right */ \
+  if(R.currentMask==0){                                   /*   and moving on to the next byte once all eight bits are sent */ \
+    R.currentMask=0x80; \
+    R.currentByte++; \
+  }
   
 ///////////////////////////////////////////////////////////////////////////////
 
-// NOW USE THE ABOVE MACRO TO CREATE THE CODE FOR EACH INTERRUPT
+// OPTIONAL TIMING OF THE INTERRUPT CODE:  T=TIMING STATISTICS (mainTiming or progTiming), N=TIMER (0, 1, or 3)
+
+// The interrupt is triggered when the timer count reaches OCRNB, so the count on entry less OCRNB is the latency before the DCC signal
+// logic started, and the count on exit less the count on entry is the time the logic took.  New OCRNA and OCRNB values are only latched
+// when the timer reaches TOP, so if the count is found to have wrapped (below OCRNB on entry, or below the entry count on exit) the new
+// values arrived too late and the current bit was sent twice.  TIMER-0 on the Uno counts every 64 cycles, so its counts are scaled by 64.
+
+#define DCC_TIMER_CYCLE_SHIFT_TIMER0 6
+#define DCC_TIMER_CYCLE_SHIFT_TIMER1 0
+#define DCC_TIMER_CYCLE_SHIFT_TIMER3 0
+
+#if ISR_TIMING == 1
+
+  #define ISR_TIMING_START(N) \
+    unsigned int isrStart=TCNT ## N;                      /* read timer count first, before anything else */ \
+    unsigned int isrMatch=OCR ## N ## B;
+
+  #define ISR_TIMING_END(T,N) \
+    unsigned int isrEnd=TCNT ## N; \
+    T.record(isrStart,isrMatch,isrEnd,DCC_TIMER_CYCLE_SHIFT_TIMER ## N);
+
+#else
+
+  #define ISR_TIMING_START(N)
+  #define ISR_TIMING_END(T,N)
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+// NOW USE THE ABOVE MACROS TO CREATE THE CODE FOR EACH INTERRUPT
 
 ISR(TIMER1_COMPB_vect){              // set interrupt service for OCR1B of TIMER-1 which flips direction bit of Motor Shield Channel A controlling Main Track
+  ISR_TIMING_START(1)
   DCC_SIGNAL(mainRegs,1)
+  ISR_TIMING_END(mainTiming,1)
 }
 
 #ifdef ARDUINO_AVR_UNO      // Configuration for UNO
 
 ISR(TIMER0_COMPB_vect){              // set interrupt service for OCR1B of TIMER-0 which flips direction bit of Motor Shield Channel B controlling Prog Track
+  ISR_TIMING_START(0)
   DCC_SIGNAL(progRegs,0)
+  ISR_TIMING_END(progTiming,0)
 }
 
 #else      // Configuration for MEGA
 
 ISR(TIMER3_COMPB_vect){              // set interrupt service for OCR3B of TIMER-3 which flips direction bit of Motor Shield Channel B controlling Prog Track
+  ISR_TIMING_START(3)
   DCC_SIGNAL(progRegs,3)
+  ISR_TIMING_END(progTiming,3)
 }
 
 #endif
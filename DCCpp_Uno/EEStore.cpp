@@ -12,6 +12,7 @@ Part of DCC++ BASE STATION for the Arduino
 #include "Accessories.h"
 #include "Sensor.h"
 #include "Outputs.h"
+#include "PacketRegister.h"
 #include <EEPROM.h>
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -35,6 +36,7 @@ void EEStore::init(){
   Turnout::load();    // load turnout definitions
   Sensor::load();     // load sensor definitions
   Output::load();     // load output definitions
+  AckCalibration::load();    // load programming track acknowledgement calibration
   
 }
 
@@ -57,6 +59,7 @@ void EEStore::store(){
   Turnout::store();
   Sensor::store();  
   Output::store();  
+  AckCalibration::store();
   EEPROM.put(0,eeStore->data);    
 }
 
@@ -0,0 +1,46 @@
+/**********************************************************************
+
+Filter.cpp
+COPYRIGHT (c) 2013-2016 Gregg E. Berman
+
+Part of DCC++ BASE STATION for the Arduino
+
+**********************************************************************/
+/**********************************************************************
+
+DCC++ BASE STATION smooths analogRead and digitalRead samples with a simple exponential filter:
+
+  new value = weight x sample + (1 - weight) x old value
+
+The Arduino has no floating-point hardware, so rather than computing this in float, ExpFilter keeps the
+smoothed value as a long with FILTER_VALUE_BITS fractional bits, and takes the weight as an int with
+FILTER_WEIGHT_BITS fractional bits, as produced by FILTER_WEIGHT().  Each update is then one long multiply
+and two shifts.  The product of the weight and the distance between the sample and the smoothed value must
+fit in the 32-bit long of the AVR, so the weight times the largest such distance, in counts, must stay below
+2048.  With weights up to 0.5, samples may range from -2047 to 2047 without overflow, which covers an
+analogRead less a baseline; a heavier weight allows a proportionally narrower range (with a weight of 1.0,
+-1023 to 1023).  Results agree with the float calculation to within one count, as tools/sim checks for
+each weight the sketch uses.
+
+**********************************************************************/
+
+#include "Filter.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+void ExpFilter::reset(int v) volatile{
+  value=(long)v<<FILTER_VALUE_BITS;
+} // ExpFilter::reset
+
+///////////////////////////////////////////////////////////////////////////////
+
+int ExpFilter::update(int sample, int weight) volatile{
+  value+=((((long)sample<<FILTER_VALUE_BITS)-value)*weight)>>FILTER_WEIGHT_BITS;
+  return(value>>FILTER_VALUE_BITS);
+} // ExpFilter::update
+
+///////////////////////////////////////////////////////////////////////////////
+
+int ExpFilter::get() volatile{
+  return(value>>FILTER_VALUE_BITS);
+} // ExpFilter::get
@@ -0,0 +1,29 @@
+/**********************************************************************
+
+Filter.h
+COPYRIGHT (c) 2013-2016 Gregg E. Berman
+
+Part of DCC++ BASE STATION for the Arduino
+
+**********************************************************************/
+
+#ifndef Filter_h
+#define Filter_h
+
+#include "Arduino.h"
+
+#define  FILTER_VALUE_BITS     8      // number of fractional bits kept in the smoothed value
+#define  FILTER_WEIGHT_BITS   12      // number of fractional bits in a smoothing weight
+
+// converts a smoothing weight from 0.0-1.0 into fixed point --- use only with constants, so that the conversion is done by the compiler
+
+#define  FILTER_WEIGHT(W)     ((int)((W)*(1L<<FILTER_WEIGHT_BITS)+0.5))
+
+struct ExpFilter{
+  long value;
+  void reset(int) volatile;
+  int update(int, int) volatile;
+  int get() volatile;
+}; // ExpFilter
+
+#endif
@@ -0,0 +1,135 @@
+/**********************************************************************
+
+OutputBuffer.cpp
+COPYRIGHT (c) 2013-2016 Gregg E. Berman
+
+Part of DCC++ BASE STATION for the Arduino
+
+**********************************************************************/
+
+// RESPONSES PRINTED TO INTERFACE ARE STORED IN A RING BUFFER, RATHER THAN BEING WRITTEN STRAIGHT TO THE SERIAL LINE OR NETWORK ONE
+// print() AT A TIME.  drain() IS CALLED ONCE EACH PASS THROUGH loop(), AND SENDS ALL COMPLETE RESPONSES (<...>) WAITING IN THE BUFFER:
+//
+//   SERIAL:   ONLY AS MANY CHARACTERS AS THE SERIAL TRANSMIT BUFFER HAS ROOM FOR, SO loop() NEVER WAITS ON THE SERIAL LINE
+//   ETHERNET: IN A SINGLE WRITE (OR TWO, IF THE RESPONSES WRAP AROUND THE END OF THE BUFFER), RATHER THAN ONE NETWORK WRITE PER print()
+//
+// IF A RESPONSE DOES NOT FIT IN THE BUFFER, OUTPUT_POLICY EITHER WAITS FOR THE INTERFACE TO TAKE ENOUGH OF THE BUFFER TO MAKE ROOM, OR
+// DISCARDS THE WHOLE RESPONSE, SO THAT A CLIENT NEVER RECEIVES PART OF ONE.  THE COUNTERS ARE REPORTED, AND RESET, WITH THE <V> COMMAND.
+
+#include "OutputBuffer.h"
+#include "Comm.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+OutputBuffer::OutputBuffer(){
+  head=0;
+  tail=0;
+  frameStart=0;
+  frameEnd=0;
+  inFrame=0;
+  dropping=0;
+  maxDepth=0;
+  dropCount=0;
+  blockCount=0;
+} // OutputBuffer::OutputBuffer
+
+///////////////////////////////////////////////////////////////////////////////
+
+size_t OutputBuffer::write(uint8_t c){
+  unsigned int depth;
+
+  if(dropping){                     // discarding the rest of a response that did not fit
+    if(c!='<'){
+      if(c=='>')
+        dropping=0;
+      return(1);
+    }
+    dropping=0;
+  }
+
+  if(c=='<' || !inFrame){           // a new response, or a character sent outside of any response, starts here
+    frameStart=head;
+    inFrame=(c=='<');
+  }
+
+  if(((head+1)&(OUTPUT_BUFFER_SIZE-1))==tail){      // buffer is full
+
+#if OUTPUT_POLICY == OUTPUT_POLICY_DROP
+
+    head=frameStart;                // discard the part of this response already stored
+    dropCount++;
+    dropping=inFrame;               // and the rest of it, up to the closing >
+    inFrame=0;
+    return(1);
+
+#else
+
+    blockCount++;
+    send(head,true);                // wait for everything stored so far, including the start of this response, to be sent
+    frameEnd=head;
+
+#endif
+
+  }
+
+  buf[head]=c;
+  head=(head+1)&(OUTPUT_BUFFER_SIZE-1);
+
+  if(c=='>' || !inFrame){           // response is complete and may be sent
+    frameEnd=head;
+    inFrame=0;
+  }
+
+  depth=(head-tail)&(OUTPUT_BUFFER_SIZE-1);
+  if(depth>maxDepth)
+    maxDepth=depth;
+
+  return(1);
+} // OutputBuffer::write
+
+///////////////////////////////////////////////////////////////////////////////
+
+void OutputBuffer::drain(){
+  send(frameEnd,false);
+} // OutputBuffer::drain
+
+///////////////////////////////////////////////////////////////////////////////
+
+// SENDS THE CHARACTERS FROM tail UP TO end.  UNLESS block IS SET, STOPS WHEN THE SERIAL TRANSMIT BUFFER IS FULL, LEAVING THE REST FOR THE NEXT CALL.
+
+void OutputBuffer::send(unsigned int end, boolean block){
+  unsigned int n;
+
+  while(tail!=end){
+    n=(end>tail?end:OUTPUT_BUFFER_SIZE)-tail;      // characters waiting before end, or before the end of buf if they wrap around
+#if COMM_TYPE == 0
+    if(!block){
+      unsigned int room=COMM_DEVICE.availableForWrite();
+      if(room==0)
+        return;
+      if(n>room)
+        n=room;
+    }
+#endif
+    COMM_DEVICE.write(buf+tail,n);
+    tail=(tail+n)&(OUTPUT_BUFFER_SIZE-1);
+  }
+} // OutputBuffer::send
+
+///////////////////////////////////////////////////////////////////////////////
+
+void OutputBuffer::show(){
+  unsigned int maxD=maxDepth, drops=dropCount, blocks=blockCount;      // take copies, since printing the counters adds to the buffer
+
+  maxDepth=0;
+  dropCount=0;
+  blockCount=0;
+
+  INTERFACE.print("<V OUT ");
+  INTERFACE.print(maxD);
+  INTERFACE.print(" ");
+  INTERFACE.print(drops);
+  INTERFACE.print(" ");
+  INTERFACE.print(blocks);
+  INTERFACE.print(">");
+} // OutputBuffer::show
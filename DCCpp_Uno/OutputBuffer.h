@@ -0,0 +1,52 @@
+/**********************************************************************
+
+OutputBuffer.h
+COPYRIGHT (c) 2013-2016 Gregg E. Berman
+
+Part of DCC++ BASE STATION for the Arduino
+
+**********************************************************************/
+
+#ifndef OutputBuffer_h
+#define OutputBuffer_h
+
+#include "Arduino.h"
+#include "DCCpp_Uno.h"
+
+// Define what happens when a response does not fit in the output buffer
+
+#define  OUTPUT_POLICY_BLOCK         0      // wait for the interface to send enough of the buffer to make room (nothing is lost)
+#define  OUTPUT_POLICY_DROP          1      // discard the whole response (loop() never waits on the interface)
+
+#define  OUTPUT_POLICY      OUTPUT_POLICY_BLOCK
+
+// Define the size of the output buffer (must be a power of 2)
+
+#ifdef ARDUINO_AVR_UNO                        // Configuration for UNO
+  #define  OUTPUT_BUFFER_SIZE      128
+#else                                         // Configuration for MEGA
+  #define  OUTPUT_BUFFER_SIZE      512
+#endif
+
+struct OutputBuffer : public Print{
+  byte buf[OUTPUT_BUFFER_SIZE];
+  unsigned int head;                // index where the next character will be stored
+  unsigned int tail;                // index of the next character to send
+  unsigned int frameStart;          // index of the start of the response being stored
+  unsigned int frameEnd;            // index just after the last complete response
+  byte inFrame;                     // set between < and >
+  byte dropping;                    // set while discarding the rest of a response that did not fit
+  unsigned int maxDepth;            // most characters waiting to be sent since counters were last reported
+  unsigned int dropCount;           // number of responses discarded since counters were last reported
+  unsigned int blockCount;          // number of times a response had to wait for room since counters were last reported
+  OutputBuffer();
+  size_t write(uint8_t);
+  using Print::write;
+  void drain();
+  void send(unsigned int, boolean);
+  void show();
+}; // OutputBuffer
+
+extern OutputBuffer outputBuffer;
+
+#endif
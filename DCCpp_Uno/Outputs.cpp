@@ -150,11 +150,11 @@ void Output::show(int n){
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void Output::parse(char *c){
-  int n,s,m;
+void Output::parse(int *p, int nParams){
+  int n=p[0],s=p[1],m=p[2];
   Output *t;
   
-  switch(sscanf(c,"%d %d %d",&n,&s,&m)){
+  switch(nParams){
     
     case 2:                     // argument is string with id number of output followed by zero (LOW) or one (HIGH)
       t=get(n);
@@ -172,7 +172,7 @@ void Output::parse(char *c){
       remove(n);
     break;
     
-    case -1:                    // no arguments
+    case 0:                     // no arguments
       show(1);                  // verbose show
     break;
   }
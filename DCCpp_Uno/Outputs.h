@@ -25,7 +25,7 @@ struct Output{
   struct OutputData data;
   Output *nextOutput;
   void activate(int s);
-  static void parse(char *c);
+  static void parse(int *, int);
   static Output* get(int);
   static void remove(int);
   static void load();
@@ -10,86 +10,199 @@ Part of DCC++ BASE STATION for the Arduino
 #include "DCCpp_Uno.h"
 #include "PacketRegister.h"
 #include "Comm.h"
+#include "EEStore.h"
+#include "CurrentMonitor.h"
+#include <EEPROM.h>
 
 ///////////////////////////////////////////////////////////////////////////////
 
 void Register::initPackets(){
-  activePacket=packet;
-  updatePacket=packet+1;
+  activePacket=&packet;
 } // Register::initPackets
 
+///////////////////////////////////////////////////////////////////////////////
+
+// CALLED FROM THE INTERRUPT ROUTINES WHEN ISR_TIMING IS SET, SO KEEP THIS SHORT
+
+void IsrTiming::record(unsigned int start, unsigned int match, unsigned int end, byte shift){
+  unsigned int cycles=(end-start)<<shift;
+  unsigned int latency=(start<match)?0xFFFF:(start-match)<<shift;      // if timer already wrapped before the interrupt started, report maximum latency
+
+  if(count==0 || cycles<minCycles)
+    minCycles=cycles;
+  if(cycles>maxCycles)
+    maxCycles=cycles;
+  if(latency>maxLatency)
+    maxLatency=latency;
+  if(start<match || end<start)                 // timer wrapped before new bit was loaded
+    lateCount++;
+  histogram[min(cycles>>5,ISR_TIMING_BUCKETS-1)]++;
+  totalCycles+=cycles;
+  count++;
+} // IsrTiming::record
+
+///////////////////////////////////////////////////////////////////////////////
+
+void IsrTiming::show(const char *track){
+  IsrTiming t;
+
+  noInterrupts();                                 // take a consistent copy of the statistics and start over
+  t=*this;
+  memset(this,0,sizeof(IsrTiming));
+  interrupts();
+
+  INTERFACE.print("<I ");
+  INTERFACE.print(track);
+  INTERFACE.print(" ");
+  INTERFACE.print(t.count);
+  INTERFACE.print(" ");
+  INTERFACE.print(t.minCycles);
+  INTERFACE.print(" ");
+  INTERFACE.print(t.count>0?t.totalCycles/t.count:0);
+  INTERFACE.print(" ");
+  INTERFACE.print(t.maxCycles);
+  INTERFACE.print(" ");
+  INTERFACE.print(t.maxLatency);
+  INTERFACE.print(" ");
+  INTERFACE.print(t.lateCount);
+  for(int i=0;i<ISR_TIMING_BUCKETS;i++){
+    INTERFACE.print(" ");
+    INTERFACE.print(t.histogram[i]);
+  }
+  INTERFACE.print(">");
+} // IsrTiming::show
+
 ///////////////////////////////////////////////////////////////////////////////
     
-RegisterList::RegisterList(int maxNumRegs){
+RegisterList::RegisterList(int maxNumRegs, int queueSize, int preambleBits, int maxConsistMembers){
   this->maxNumRegs=maxNumRegs;
+  this->preambleBits=preambleBits;
   reg=(Register *)calloc((maxNumRegs+1),sizeof(Register));
   for(int i=0;i<=maxNumRegs;i++)
     reg[i].initPackets();
   regMap=(Register **)calloc((maxNumRegs+1),sizeof(Register *));
   speedTable=(int *)calloc((maxNumRegs+1),sizeof(int *));
+  cabTable=(int *)calloc((maxNumRegs+1),sizeof(int));
+  cabIndex=(byte *)calloc(maxNumRegs,sizeof(byte));
+  lastCommand=(unsigned int *)calloc((maxNumRegs+1),sizeof(unsigned int));
+  nCabs=0;
+  commandCount=0;
+  functionTable=(FunctionState *)calloc((maxNumRegs+1),sizeof(FunctionState));
+  functionReg=1;
+  functionGroup=0;
+  functionTime=0;
+  this->maxConsistMembers=maxConsistMembers;
+  consistTable=(maxConsistMembers>0)?(ConsistMember *)calloc(maxConsistMembers,sizeof(ConsistMember)):NULL;    // only the Main Track keeps a consist table
+  this->queueSize=queueSize;
+  updateQueue=(RegisterUpdate *)calloc((queueSize+1),sizeof(RegisterUpdate));       // one extra slot so that a full queue can be distinguished from an empty queue
+  for(int i=0;i<=queueSize;i++)
+    updateQueue[i].packet=(Packet *)calloc(1,sizeof(Packet));                       // each slot owns a spare Packet that is swapped with the active Packet of a Register when the update is processed
+  queueHead=0;
+  queueTail=0;
+  queueMaxDepth=0;
+  queueFullCount=0;
+  priorityRegs=(Register **)calloc((maxNumRegs+1),sizeof(Register *));           // each permanent Register appears at most once, plus one extra slot so that a full list can be distinguished from an empty list
+  priorityHead=0;
+  priorityTail=0;
+  nBurst=0;
+  refreshReg=reg;
+  packetCount=0;
+  oneShotCount=0;
   currentReg=reg;
   regMap[0]=reg;
   maxLoadedReg=reg;
-  nextReg=NULL;
-  currentBit=0;
+  maxMappedReg=reg;
+  currentByte=NULL;
+  currentMask=0;
+  bitsLeft=0;
   nRepeat=0;
+  stopReg=(Register *)calloc(1,sizeof(Register));     // holds the emergency stop packet, which is sent outside of the normal Register cycle
+  stopReg->initPackets();
+  nStop=0;
+  cvOp.state=CV_STATE_IDLE;
+  cvOp.nSamples=0;
 } // RegisterList::RegisterList
   
 ///////////////////////////////////////////////////////////////////////////////
 
+// CONVERTS 2, 3, 4, OR 5 BYTES INTO THE DCC BIT STREAM OF PACKET p, WITH PREAMBLE, CHECKSUM, AND PROPER BYTE SEPARATORS
+// THE CHECKSUM IS ALSO STORED IN b[nBytes], SO b MUST HAVE SPACE FOR ONE EXTRA BYTE
+
+void RegisterList::buildPacket(Packet *p, byte *b, int nBytes) volatile {
+  byte *buf=p->buf;                   // set byte buffer in the Packet to be updated
+          
+  b[nBytes]=b[0];                        // copy first byte into what will become the checksum byte  
+  for(int i=1;i<nBytes;i++)              // XOR remaining bytes into checksum byte
+    b[nBytes]^=b[i];
+  nBytes++;                              // increment number of bytes in packet to include checksum byte
+
+  for(int i=0;i<10;i++)                  // clear buffer so that only one bits need to be set
+    buf[i]=0;
+
+  byte nBits;
+  for(nBits=0;nBits<preambleBits;nBits++)          // preamble of one bits
+    bitSet(buf[nBits/8],7-nBits%8);
+
+  for(int i=0;i<nBytes;i++){
+    nBits++;                                         // data start bit (zero) before each byte
+    for(int j=7;j>=0;j--,nBits++)                    // byte, most significant bit first
+      if(bitRead(b[i],j))
+        bitSet(buf[nBits/8],7-nBits%8);
+  }
+
+  p->nBits=nBits;                        // packet end bit is supplied by first bit of the next packet's preamble
+
+} // RegisterList::buildPacket
+
+///////////////////////////////////////////////////////////////////////////////
+
 // LOAD DCC PACKET INTO TEMPORARY REGISTER 0, OR PERMANENT REGISTERS 1 THROUGH DCC_PACKET_QUEUE_MAX (INCLUSIVE)
 // CONVERTS 2, 3, 4, OR 5 BYTES INTO A DCC BIT STREAM WITH PREAMBLE, CHECKSUM, AND PROPER BYTE SEPARATORS
-// BITSTREAM IS STORED IN UP TO A 10-BYTE ARRAY (USING AT MOST 76 OF 80 BITS)
+// BITSTREAM IS STORED IN UP TO A 10-BYTE ARRAY (USING AT MOST preambleBits+54 OF 80 BITS)
+
+// THE PACKET IS BUILT IN THE SPARE PACKET OF THE NEXT FREE SLOT OF THE UPDATE QUEUE.  THE QUEUE IS A SINGLE-PRODUCER/SINGLE-CONSUMER
+// RING: ONLY loadPacket() ADVANCES queueHead AND ONLY THE INTERRUPT ROUTINE ADVANCES queueTail, SO NO LOCKING IS NEEDED TO ADD AN UPDATE.
+// loadPacket() ONLY PAUSES IF THE QUEUE IS FULL.  A PENDING UPDATE FOR THE SAME PERMANENT REGISTER IS REPLACED RATHER THAN QUEUED TWICE.
 
 void RegisterList::loadPacket(int nReg, byte *b, int nBytes, int nRepeat, int printFlag) volatile {
   
   nReg=nReg%((maxNumRegs+1));          // force nReg to be between 0 and maxNumRegs, inclusive
 
-  while(nextReg!=NULL);              // pause while there is a Register already waiting to be updated -- nextReg will be reset to NULL by interrupt when prior Register updated fully processed
+  byte nextHead=(queueHead==queueSize)?0:queueHead+1;
+
+  if(nextHead==queueTail){            // queue is full
+    queueFullCount++;
+    while(nextHead==queueTail);       // pause until the interrupt routine removes the oldest update from the queue
+  }
  
   if(regMap[nReg]==NULL)              // first time this Register Number has been called
-   regMap[nReg]=maxLoadedReg+1;       // set Register Pointer for this Register Number to next available Register
+   regMap[nReg]=++maxMappedReg;       // set Register Pointer for this Register Number to next available Register (it joins the refresh cycle once the interrupt routine takes this first update from the queue)
  
   Register *r=regMap[nReg];           // set Register to be updated
-  Packet *p=r->updatePacket;          // set Packet in the Register to be updated
-  byte *buf=p->buf;                   // set byte buffer in the Packet to be updated
-          
-  b[nBytes]=b[0];                        // copy first byte into what will become the checksum byte  
-  for(int i=1;i<nBytes;i++)              // XOR remaining bytes into checksum byte
-    b[nBytes]^=b[i];
-  nBytes++;                              // increment number of bytes in packet to include checksum byte
-      
-  buf[0]=0xFF;                        // first 8 bytes of 22-byte preamble
-  buf[1]=0xFF;                        // second 8 bytes of 22-byte preamble
-  buf[2]=0xFC + bitRead(b[0],7);      // last 6 bytes of 22-byte preamble + data start bit + b[0], bit 7
-  buf[3]=b[0]<<1;                     // b[0], bits 6-0 + data start bit
-  buf[4]=b[1];                        // b[1], all bits
-  buf[5]=b[2]>>1;                     // b[2], bits 7-1
-  buf[6]=b[2]<<7;                     // b[2], bit 0
-  
-  if(nBytes==3){
-    p->nBits=49;
-  } else{
-    buf[6]+=b[3]>>2;                  // b[3], bits 7-2
-    buf[7]=b[3]<<6;                   // b[3], bit 1-0
-    if(nBytes==4){
-      p->nBits=58;
-    } else{
-      buf[7]+=b[4]>>3;                // b[4], bits 7-3
-      buf[8]=b[4]<<5;                 // b[4], bits 2-0
-      if(nBytes==5){
-        p->nBits=67;
-      } else{
-        buf[8]+=b[5]>>4;              // b[5], bits 7-4
-        buf[9]=b[5]<<4;               // b[5], bits 3-0
-        p->nBits=76;
-      } // >5 bytes
-    } // >4 bytes
-  } // >3 bytes
-  
-  nextReg=r;
-  this->nRepeat=nRepeat;
-  maxLoadedReg=max(maxLoadedReg,nextReg);
+  Packet *p=updateQueue[queueHead].packet;    // set Packet in the free queue slot to be updated
+
+  buildPacket(p,b,nBytes);
+  nBytes++;                           // include checksum byte added by buildPacket()
+
+  if(nReg>0){                                                 // for permanent Registers, check whether an earlier update is still waiting in the queue
+    noInterrupts();                                           // briefly stop the interrupt routine from removing updates while the queue is scanned
+    for(byte i=queueTail;i!=queueHead;i=(i==queueSize)?0:i+1){
+      if(updateQueue[i].reg==r){                              // found a pending update for the same Register
+        updateQueue[queueHead].packet=updateQueue[i].packet;  //   swap Packets so the pending update now carries the new bits, and the stale Packet returns to the free slot
+        updateQueue[i].packet=p;
+        r=NULL;
+        break;
+      }
+    }
+    interrupts();
+  }
+
+  if(r!=NULL){                                   // add new update to queue
+    updateQueue[queueHead].reg=r;
+    updateQueue[queueHead].nRepeat=(nReg>0)?PRIORITY_REFRESH_COUNT:nRepeat;    // for permanent Registers, the repeat count instead sets how many times the new packet is re-sent ahead of the background refresh
+    queueHead=nextHead;                          // update becomes visible to interrupt routine only after it is fully written
+    queueMaxDepth=max(queueMaxDepth,queueDepth());
+  }
   
   if(printFlag && SHOW_PACKETS)       // for debugging purposes
     printPacket(nReg,b,nBytes,nRepeat);  
@@ -98,7 +211,62 @@ void RegisterList::loadPacket(int nReg, byte *b, int nBytes, int nRepeat, int pr
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void RegisterList::setThrottle(char *s) volatile{
+byte RegisterList::queueDepth() volatile {
+  byte n=queueHead+(queueSize+1)-queueTail;
+  return(n>queueSize?n-(queueSize+1):n);
+} // RegisterList::queueDepth
+
+///////////////////////////////////////////////////////////////////////////////
+
+// REPORTS PACKETS SENT ON THIS TRACK AND HOW MANY OF THOSE WERE ONE-TIME PACKETS (INCLUDING REPEATS) FROM REGISTER 0,
+// FOLLOWED BY THE LAST AND MAXIMUM REFRESH INTERVAL, IN PACKETS, OF EACH LOADED REGISTER, THEN STARTS OVER
+
+void RegisterList::showTelemetry(const char *track) volatile{
+  unsigned long nPackets, nOneShots;
+  unsigned int last, maxInt;
+
+  noInterrupts();                       // take a consistent copy of the counters and start over
+  nPackets=packetCount;
+  nOneShots=oneShotCount;
+  packetCount=0;
+  oneShotCount=0;
+  for(Register *p=reg;p<=maxLoadedReg;p++)
+    p->lastSent=0;
+  interrupts();
+
+  INTERFACE.print("<V ");
+  INTERFACE.print(track);
+  INTERFACE.print(" ");
+  INTERFACE.print(nPackets);
+  INTERFACE.print(" ");
+  INTERFACE.print(nOneShots);
+  INTERFACE.print(">");
+
+  for(int i=1;i<=maxNumRegs;i++){
+    if(regMap[i]==NULL)
+      continue;
+    noInterrupts();
+    last=regMap[i]->lastInterval;
+    maxInt=regMap[i]->maxInterval;
+    regMap[i]->maxInterval=0;
+    interrupts();
+    INTERFACE.print("<v ");
+    INTERFACE.print(track);
+    INTERFACE.print(" ");
+    INTERFACE.print(i);
+    INTERFACE.print(" ");
+    INTERFACE.print(cabTable[i]);
+    INTERFACE.print(" ");
+    INTERFACE.print(last);
+    INTERFACE.print(" ");
+    INTERFACE.print(maxInt);
+    INTERFACE.print(">");
+  }
+} // RegisterList::showTelemetry
+
+///////////////////////////////////////////////////////////////////////////////
+
+void RegisterList::setThrottle(int *p, int nParams) volatile{
   byte b[5];                      // save space for checksum byte
   int nReg;
   int cab;
@@ -106,8 +274,29 @@ void RegisterList::setThrottle(char *s) volatile{
   int tDirection;
   byte nB=0;
   
-  if(sscanf(s,"%d %d %d %d",&nReg,&cab,&tSpeed,&tDirection)!=4)
-    return;
+  switch(nParams){
+
+    case 4:                     // register, cab, speed, and direction
+      nReg=p[0];
+      cab=p[1];
+      tSpeed=p[2];
+      tDirection=p[3];
+      break;
+
+    case 3:                     // cab, speed, and direction only --- select a register automatically
+      cab=p[0];
+      tSpeed=p[1];
+      tDirection=p[2];
+      nReg=allocateCab(cab);
+      if(nReg==0){              // every register holds a moving loco
+        INTERFACE.print("<X>");
+        return;
+      }
+      break;
+
+    default:
+      return;
+  }
 
   if(nReg<1 || nReg>maxNumRegs)
     return;  
@@ -133,23 +322,187 @@ void RegisterList::setThrottle(char *s) volatile{
   INTERFACE.print(">");
   
   speedTable[nReg]=tDirection==1?tSpeed:-tSpeed;
+  setCab(nReg,cab);
+  lastCommand[nReg]=++commandCount;
     
 } // RegisterList::setThrottle()
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void RegisterList::setFunction(char *s) volatile{
+// AN EMERGENCY STOP MUST NOT WAIT BEHIND THE UPDATE QUEUE OR THE REFRESH CYCLE.  WHILE nStop IS NON-ZERO THE INTERRUPT ROUTINE SENDS ONLY
+// THE PACKET IN stopReg (A BROADCAST EMERGENCY STOP, OR AN EMERGENCY STOP FOR A SINGLE CAB), STARTING AT THE NEXT PACKET BOUNDARY.
+// WHILE THE INTERRUPT ROUTINE IS HELD ON stopReg, NO OTHER PACKET CAN BE IN USE, SO THE SPEED PACKETS OF EVERY AFFECTED REGISTER (AND OF
+// ANY PENDING UPDATES FOR THOSE REGISTERS) ARE REWRITTEN IN PLACE TO EMERGENCY STOP BEFORE THE REFRESH CYCLE RESUMES.  OTHERWISE THE NEXT
+// REFRESH OF AN OLD SPEED PACKET WOULD START THE ENGINE AGAIN.  emergencyStop() WAITS FOR THE INTERRUPT ROUTINE TO REACH stopReg, WHICH IT
+// ALWAYS DOES AT THE END OF THE PACKET IN PROGRESS (AT MOST preambleBits+54 BITS, UNDER 13 MS), SINCE THE DCC TIMERS RUN WHETHER OR NOT THE
+// TRACK IS POWERED.  ONE-TIME PACKETS IN REGISTER 0 ARE NOT REWRITTEN OR DISCARDED:  THEY ARE SENT IN FULL ONCE THE EMERGENCY STOP IS DONE.
+
+void RegisterList::emergencyStop(int *p, int nParams) volatile{
+  byte b[5];                      // save space for checksum byte
+  byte nB;
+  int cab;
+
+  if(nParams!=1)                  // no cab specified --- stop all cabs with the broadcast address
+    cab=0;
+  else
+    cab=p[0];
+
+  if(cab<0 || cab>10293){
+    INTERFACE.print("<X>");
+    return;
+  }
+
+  while(nStop>0 || currentReg==stopReg);    // pause until any earlier emergency stop has finished, since its packet is about to be re-written
+
+  nB=0;
+  if(cab>127)
+    b[nB++]=highByte(cab) | 0xC0;      // convert train number into a two-byte address
+  b[nB++]=lowByte(cab);
+  b[nB++]=0x3F;                        // 128-step speed control byte
+  b[nB++]=1;                           // emergency stop
+  buildPacket(stopReg->activePacket,b,nB);
+
+  nStop=255;                           // send emergency stop packets at the next packet boundary, and keep sending them until the registers are updated
+  while(currentReg!=stopReg);          // pause until the interrupt routine has switched to stopReg
+
+  for(int i=1;i<=maxNumRegs;i++){
+    if(cabTable[i]<=0 || (cab>0 && cabTable[i]!=cab))      // no cab, or a raw packet written with <M>
+      continue;
+    nB=0;
+    if(cabTable[i]>127)
+      b[nB++]=highByte(cabTable[i]) | 0xC0;
+    b[nB++]=lowByte(cabTable[i]);
+    b[nB++]=0x3F;
+    b[nB++]=1;
+    buildPacket(regMap[i]->activePacket,b,nB);
+    for(byte j=queueTail;j!=queueHead;j=(j==queueSize)?0:j+1)    // the interrupt routine does not take updates from the queue while sending stopReg
+      if(updateQueue[j].reg==regMap[i])
+        buildPacket(updateQueue[j].packet,b,nB);
+    speedTable[i]=0;
+  }
+
+  nStop=ESTOP_REPEAT_COUNT;            // release the interrupt routine after the remaining emergency stop packets
+
+  INTERFACE.print("<O>");
+
+} // RegisterList::emergencyStop()
+
+///////////////////////////////////////////////////////////////////////////////
+
+// CAB ADDRESSES ARE TRACKED IN cabTable, INDEXED BY REGISTER NUMBER, WITH cabIndex HOLDING THE REGISTER NUMBERS OF ALL
+// nCabs CABS IN ORDER OF INCREASING CAB ADDRESS SO THAT A CAB CAN BE FOUND WITH A BINARY SEARCH.  A REGISTER HOLDING A RAW PACKET
+// WRITTEN WITH <M> IS MARKED CAB_RAW, AND IS NOT IN cabIndex.  A CAB IS NEVER HELD BY TWO REGISTERS:  IF IT IS SET INTO A NEW
+// REGISTER, ITS OLD REGISTER IS RELEASED, AND ITS STORED FUNCTIONS MOVE WITH IT.
+
+int RegisterList::findCab(int cab) volatile{
+  int lo=0;
+  int hi=nCabs-1;
+
+  while(lo<=hi){
+    int mid=(lo+hi)/2;
+    int c=cabTable[cabIndex[mid]];
+    if(c==cab)
+      return(cabIndex[mid]);
+    if(c<cab)
+      lo=mid+1;
+    else
+      hi=mid-1;
+  }
+
+  return(0);
+} // RegisterList::findCab()
+
+///////////////////////////////////////////////////////////////////////////////
+
+void RegisterList::setCab(int nReg, int cab) volatile{
+  int i,j;
+  FunctionState f={{0},0};                // stored functions of the previous cab are dropped
+
+  if(cabTable[nReg]==cab)                 // register already holds this cab
+    return;
+
+  if(cab>0 && (i=findCab(cab))>0){        // cab is moving from another register --- keep its functions, and release the old register
+    f=functionTable[i];
+    releaseCab(i);
+  }
+
+  if(cabTable[nReg]>0){                   // remove the cab previously held by this register from the index
+    for(i=0;cabIndex[i]!=nReg;i++);
+    for(nCabs--;i<nCabs;i++)
+      cabIndex[i]=cabIndex[i+1];
+  }
+
+  cabTable[nReg]=cab;
+  functionTable[nReg]=f;
+  if(cab<=0)
+    return;
+
+  for(i=0;i<nCabs && cabTable[cabIndex[i]]<cab;i++);    // find insertion point and shift larger cabs up one place
+  for(j=nCabs;j>i;j--)
+    cabIndex[j]=cabIndex[j-1];
+  cabIndex[i]=nReg;
+  nCabs++;
+} // RegisterList::setCab()
+
+///////////////////////////////////////////////////////////////////////////////
+
+// REPLACES THE PACKET OF A REGISTER NO LONGER NEEDED BY ITS CAB WITH THE IDLE PACKET, AND FREES THE REGISTER FOR RE-USE
+
+void RegisterList::releaseCab(int nReg) volatile{
+  loadPacket(nReg,idlePacket,2,0);
+  speedTable[nReg]=0;
+  setCab(nReg,0);
+} // RegisterList::releaseCab()
+
+///////////////////////////////////////////////////////////////////////////////
+
+// RETURNS THE REGISTER ALREADY HOLDING THIS CAB, OR ELSE THE FIRST REGISTER NEVER LOADED, OR ELSE THE FIRST REGISTER HOLDING ONLY THE
+// IDLE PACKET (REGISTER 1 AT START-UP, OR A RELEASED REGISTER), OR ELSE THE REGISTER OF THE LEAST-RECENTLY-COMMANDED STOPPED CAB (WHICH
+// IS EVICTED), OR ZERO IF EVERY REGISTER HOLDS A MOVING CAB OR A RAW PACKET WRITTEN WITH <M>
+
+int RegisterList::allocateCab(int cab) volatile{
+  int nReg;
+  unsigned int age,maxAge=0;
+
+  if((nReg=findCab(cab))>0)
+    return(nReg);
+
+  for(int i=1;i<=maxNumRegs;i++)
+    if(regMap[i]==NULL)
+      return(i);
+
+  for(int i=1;i<=maxNumRegs;i++)
+    if(cabTable[i]==0)
+      return(i);
+
+  for(int i=1;i<=maxNumRegs;i++){
+    age=commandCount-lastCommand[i];      // unsigned arithmetic keeps ages correct even after commandCount wraps
+    if(cabTable[i]>0 && speedTable[i]==0 && age>=maxAge){
+      maxAge=age;
+      nReg=i;
+    }
+  }
+
+  return(nReg);
+} // RegisterList::allocateCab()
+
+///////////////////////////////////////////////////////////////////////////////
+
+void RegisterList::setFunction(int *p, int nParams) volatile{
   byte b[5];                      // save space for checksum byte
   int cab;
   int fByte, eByte;
-  int nParams;
+  int nReg;
+  byte fGroup, fValue;
   byte nB=0;
   
-  nParams=sscanf(s,"%d %d %d",&cab,&fByte,&eByte);
-  
   if(nParams<2)
     return;
 
+  cab=p[0];
+  fByte=p[1];
+  eByte=p[2];
+
   if(cab>127)
     b[nB++]=highByte(cab) | 0xC0;      // convert train number into a two-byte address
     
@@ -157,25 +510,87 @@ void RegisterList::setFunction(char *s) volatile{
 
   if(nParams==2){                      // this is a request for functions FL,F1-F12  
     b[nB++]=(fByte | 0x80) & 0xBF;     // for safety this guarantees that first nibble of function byte will always be of binary form 10XX which should always be the case for FL,F1-F12  
+    if((b[nB-1]&0xE0)==0x80)           // determine function group from instruction byte: 100X XXXX = FL,F1-F4; 1011 XXXX = F5-F8; 1010 XXXX = F9-F12
+      fGroup=0;
+    else
+      fGroup=(b[nB-1]&0x10)?1:2;
+    fValue=b[nB-1];
   } else {                             // this is a request for functions F13-F28
     b[nB++]=(fByte | 0xDE) & 0xDF;     // for safety this guarantees that first byte will either be 0xDE (for F13-F20) or 0xDF (for F21-F28)
     b[nB++]=eByte;
+    fGroup=3+(b[nB-2]&0x01);
+    fValue=eByte;
   }
     
   loadPacket(0,b,nB,4,1);
+
+  if((nReg=findCab(cab))>0){          // if cab holds a throttle register, store function group so it can be refreshed
+    functionTable[nReg].group[fGroup]=fValue;
+    bitSet(functionTable[nReg].groupMask,fGroup);
+  }
     
 } // RegisterList::setFunction()
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void RegisterList::setAccessory(char *s) volatile{
+// RE-SENDS ONE STORED FUNCTION GROUP EVERY FUNCTION_REFRESH_TIME, CYCLING THROUGH EVERY GROUP THAT HAS BEEN SET FOR EVERY CAB HOLDING
+// A THROTTLE REGISTER.  THE PACKET IS SENT ONCE THROUGH REGISTER 0, AND ONLY WHEN NO OTHER UPDATE IS WAITING, SO THAT FUNCTION
+// REFRESHES NEVER DELAY NEW COMMANDS AND ARE SENT AT A MUCH LOWER RATE THAN THE SPEED PACKETS IN THE REGULAR REFRESH CYCLE
+
+void RegisterList::refreshFunctions() volatile{
+  byte b[5];                      // save space for checksum byte
+  byte nB=0;
+  int cab;
+
+  if(millis()-functionTime<FUNCTION_REFRESH_TIME || queueDepth()>0)
+    return;
+  functionTime=millis();
+
+  for(int i=0;i<maxNumRegs*FUNCTION_GROUPS;i++){        // find next stored function group, searching at most once around the table
+    if(++functionGroup==FUNCTION_GROUPS){
+      functionGroup=0;
+      if(++functionReg>maxNumRegs)
+        functionReg=1;
+    }
+    if(bitRead(functionTable[functionReg].groupMask,functionGroup))
+      break;
+  }
+
+  if(!bitRead(functionTable[functionReg].groupMask,functionGroup))     // no function groups stored
+    return;
+
+  cab=cabTable[functionReg];
+
+  if(cab>127)
+    b[nB++]=highByte(cab) | 0xC0;      // convert train number into a two-byte address
+    
+  b[nB++]=lowByte(cab);
+
+  if(functionGroup<3){
+    b[nB++]=functionTable[functionReg].group[functionGroup];
+  } else {
+    b[nB++]=0xDE + functionGroup-3;          // 0xDE for F13-F20, 0xDF for F21-F28
+    b[nB++]=functionTable[functionReg].group[functionGroup];
+  }
+
+  loadPacket(0,b,nB,0);
+
+} // RegisterList::refreshFunctions()
+
+///////////////////////////////////////////////////////////////////////////////
+
+void RegisterList::setAccessory(int *p, int nParams) volatile{
   byte b[3];                      // save space for checksum byte
   int aAdd;                       // the accessory address (0-511 = 9 bits) 
   int aNum;                       // the accessory number within that address (0-3)
   int activate;                   // flag indicated whether accessory should be activated (1) or deactivated (0) following NMRA recommended convention
   
-  if(sscanf(s,"%d %d %d",&aAdd,&aNum,&activate)!=3)
+  if(nParams!=3)
     return;
+
+  aAdd=p[0];
+  aNum=p[1];
+  activate=p[2];
     
   b[0]=aAdd%64+128;                                           // first byte is of the form 10AAAAAA, where AAAAAA represent 6 least signifcant bits of accessory address  
   b[1]=((((aAdd/64)%8)<<4) + (aNum%4<<1) + activate%2) ^ 0xF8;      // second byte is of the form 1AAACDDD, where C should be 1, and the least significant D represent activate/deactivate
@@ -186,146 +601,421 @@ void RegisterList::setAccessory(char *s) volatile{
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void RegisterList::writeTextPacket(char *s) volatile{
+void RegisterList::writeTextPacket(int *p, int nParams) volatile{
   
   int nReg;
   byte b[6];
   int nBytes;
   volatile RegisterList *regs;
     
-  nBytes=sscanf(s,"%d %x %x %x %x %x",&nReg,b,b+1,b+2,b+3,b+4)-1;
+  nBytes=nParams-1;
   
   if(nBytes<2 || nBytes>5){    // invalid valid packet
     INTERFACE.print("<mInvalid Packet>");
     return;
   }
+
+  nReg=p[0];
+  for(int i=0;i<nBytes;i++)
+    b[i]=p[i+1];
          
   loadPacket(nReg,b,nBytes,0,1);
+
+  nReg=nReg%((maxNumRegs+1));          // as in loadPacket()
+  if(nReg>0){                          // the register no longer holds a cab, and is left alone by automatic register selection
+    speedTable[nReg]=0;
+    setCab(nReg,CAB_RAW);
+  }
     
 } // RegisterList::writeTextPacket()
   
 ///////////////////////////////////////////////////////////////////////////////
 
-void RegisterList::readCV(char *s) volatile{
-  byte bRead[4];
+// CV OPERATIONS ON THE PROGRAMMING TRACK ARE CARRIED OUT BY A STATE MACHINE THAT processCV() ADVANCES ONE SHORT STEP AT A TIME FROM loop(),
+// SO THAT THE MAIN TRACK, CURRENT MONITORING, SENSORS, AND COMMAND PROCESSING ALL CONTINUE WHILE A CV IS BEING READ OR WRITTEN.
+// readCV(), writeCVByte(), AND writeCVBit() ONLY SET UP THE OPERATION --- THE <r> RESPONSE IS PRINTED BY processCV() WHEN IT COMPLETES.
+// EACH STEP EITHER LOADS ONE PACKET (ONLY WHEN THE UPDATE QUEUE IS EMPTY, SO loadPacket() NEVER PAUSES), OR PROCESSES THE CURRENT SAMPLES
+// COLLECTED SINCE THE LAST STEP BY THE INTERRUPT-DRIVEN CurrentSampler.  SAMPLES ARRIVE EVERY ACK_SAMPLE_MICROS, SO COUNTING SAMPLES MEASURES TIME.
+// IF A SLOW PASS THROUGH loop() LETS SAMPLES BE OVERWRITTEN WHILE WAITING FOR AN ACKNOWLEDGEMENT, THE WIDTH OF ANY PULSE IS UNKNOWN (TWO PULSES FROM
+// A DECODER THAT ACKNOWLEDGES EVERY VERIFY PACKET COULD LOOK LIKE ONE LONG ONE), SO THE VERIFY IS SENT AGAIN, UP TO ACK_RETRY_MAX TIMES BEFORE
+// THE OPERATION IS REPORTED AS FAILED.
+
+// AN ACKNOWLEDGEMENT IS ONLY ACCEPTED IF THE SMOOTHED CURRENT STAYS ABOVE ACK_SAMPLE_THRESHOLD FOR A TIME WITHIN THE ACK_PULSE_MIN TO ACK_PULSE_MAX
+// WINDOW (NMRA S-9.2.3 SPECIFIES A 6 MS PULSE), SO SHORT SPIKES AND SUSTAINED LOADS ARE IGNORED.  A VERIFY ENDS AS SOON AS A VALID PULSE IS SEEN,
+// RATHER THAN ALWAYS TAKING ACK_SAMPLE_COUNT SAMPLES, AND THE BASELINE CURRENT IS ONLY MEASURED ONCE PER CV RATHER THAN BEFORE EVERY VERIFY.
+
+void RegisterList::readCV(int *p, int nParams) volatile{
+  int cv, lastCV, callBack, callBackSub;
+
+  switch(nParams){
+
+    case 3:                     // single cv, callBack, and callBackSub
+      cv=p[0];
+      lastCV=cv;
+      callBack=p[1];
+      callBackSub=p[2];
+      break;
+
+    case 4:                     // range of cvs from cv through lastCV, callBack, and callBackSub
+      cv=p[0];
+      lastCV=p[1];
+      callBack=p[2];
+      callBackSub=p[3];
+      if(lastCV<cv)
+        return;
+      break;
+
+    case 0:                     // no arguments --- cancel read in progress
+      cancelCV();
+      return;
+
+    default:
+      return;
+  }
+
+  if(startCV(CV_OP_READ,cv,0,0,callBack,callBackSub)==0)      // cv = 1-1024
+    return;
+
+  cvOp.lastCV=lastCV-1;
+  if(lastCV>cv)
+    cvOp.batch=1;
+  startRead();
+
+  if(lastCV>cv)
+    cvOp.state=CV_STATE_START;
+        
+} // RegisterList::readCV()
+
+///////////////////////////////////////////////////////////////////////////////
+
+// SETS UP THE FIRST VERIFY FOR READING cvOp.cv.  IF THE CV WAS RECENTLY READ OR WRITTEN, THE REMEMBERED VALUE IS FIRST CHECKED WITH A SINGLE
+// VERIFY-BYTE, AND THE CV IS ONLY READ BIT BY BIT IF THE DECODER DOES NOT ACKNOWLEDGE IT
+
+void RegisterList::startRead() volatile{
+  int v;
+
+  cvOp.bNum=0;
+  cvOp.bValue=0;
+  cvOp.packet[1]=lowByte(cvOp.cv);
+
+  if((v=CVCache::get(cvOp.cv))>=0){
+    cvOp.packet[0]=0x74+(highByte(cvOp.cv)&0x03);   // verify byte
+    cvOp.packet[2]=v;
+    cvOp.bValue=v;
+    cvOp.speculative=1;
+  } else{
+    cvOp.packet[0]=0x78+(highByte(cvOp.cv)&0x03);   // any CV>1023 will become modulus(1024) due to bit-mask of 0x03
+    cvOp.packet[2]=0xE8;                             // verify bit 0 first
+    cvOp.speculative=0;
+  }
+
+  cvOp.base=0;
+  cvOp.tail=CurrentSampler::head[CURRENT_CHANNEL_PROG];     // baseline starts with the next new sample
+  cvOp.state=CV_STATE_BASE;
+
+} // RegisterList::startRead()
+
+///////////////////////////////////////////////////////////////////////////////
+
+void RegisterList::writeCVByte(int *p, int nParams) volatile{
   int bValue;
-  int c,d,base;
   int cv, callBack, callBackSub;
 
-  if(sscanf(s,"%d %d %d",&cv,&callBack,&callBackSub)!=3)          // cv = 1-1024
+  if(nParams!=4)
     return;    
-  cv--;                              // actual CV addresses are cv-1 (0-1023)
+
+  cv=p[0];                        // cv = 1-1024
+  bValue=p[1];
+  callBack=p[2];
+  callBackSub=p[3];
+
+  if(startCV(CV_OP_WRITE_BYTE,cv,0,bValue,callBack,callBackSub)==0)
+    return;
   
-  bRead[0]=0x78+(highByte(cv)&0x03);   // any CV>1023 will become modulus(1024) due to bit-mask of 0x03
-  bRead[1]=lowByte(cv);
+  cvOp.packet[0]=0x7C+(highByte(cvOp.cv)&0x03);   // any CV>1023 will become modulus(1024) due to bit-mask of 0x03
+  cvOp.packet[1]=lowByte(cvOp.cv);
+  cvOp.packet[2]=bValue;
+  cvOp.state=CV_STATE_WRITE;
+
+} // RegisterList::writeCVByte()
   
-  bValue=0;
+///////////////////////////////////////////////////////////////////////////////
+
+void RegisterList::writeCVBit(int *p, int nParams) volatile{
+  int bNum,bValue;
+  int cv, callBack, callBackSub;
+
+  if(nParams!=5)
+    return;    
+
+  cv=p[0];                        // cv = 1-1024
+  bNum=p[1]%8;
+  bValue=p[2]%2;
+  callBack=p[3];
+  callBackSub=p[4];
+
+  if(startCV(CV_OP_WRITE_BIT,cv,bNum,bValue,callBack,callBackSub)==0)
+    return;
   
-  for(int i=0;i<8;i++){
-    
-    c=0;
-    d=0;
-    base=0;
+  cvOp.packet[0]=0x78+(highByte(cvOp.cv)&0x03);   // any CV>1023 will become modulus(1024) due to bit-mask of 0x03
+  cvOp.packet[1]=lowByte(cvOp.cv);  
+  cvOp.packet[2]=0xF0+bValue*8+bNum;
+  cvOp.state=CV_STATE_WRITE;
+
+} // RegisterList::writeCVBit()
+
+///////////////////////////////////////////////////////////////////////////////
+
+// RECORDS THE PARAMETERS OF A NEW CV OPERATION, OR IF ANOTHER OPERATION IS STILL RUNNING, IMMEDIATELY REPORTS THE NEW ONE AS FAILED AND RETURNS 0.
+// A BATCH READ THAT HAS PRINTED ITS LAST <r> BUT NOT YET RESTORED IDLE PACKETS TO REGISTER 1 IS NOT BUSY --- THE NEW OPERATION RUNS WITH THE
+// RESET PACKETS STILL IN THE BACKGROUND AND RESTORES THE IDLE PACKETS WHEN IT ENDS
+
+int RegisterList::startCV(byte op, int cv, int bNum, int bValue, int callBack, int callBackSub) volatile{
+  byte batch=(cvOp.state==CV_STATE_END);
+
+  if(cvOp.state!=CV_STATE_IDLE && !batch){  // busy
+    printCV(op,cv-1,bNum,-1,callBack,callBackSub);
+    return(0);
+  }
+
+  cvOp.op=op;
+  cvOp.cv=cv-1;                   // actual CV addresses are cv-1 (0-1023)
+  cvOp.bNum=bNum;
+  cvOp.bValue=bValue;
+  cvOp.callBack=callBack;
+  cvOp.callBackSub=callBackSub;
+  cvOp.lastCV=cvOp.cv;
+  cvOp.batch=batch;
+  cvOp.speculative=0;
+  cvOp.nSent=0;
+  cvOp.nRetries=0;
+  cvOp.nSamples=0;
+  return(1);
+
+} // RegisterList::startCV()
+
+///////////////////////////////////////////////////////////////////////////////
 
-    for(int j=0;j<ACK_BASE_COUNT;j++)
-      base+=analogRead(CURRENT_MONITOR_PIN_PROG);
-    base/=ACK_BASE_COUNT;
+// THE PACKET SEQUENCES USED BY THE STATE MACHINE:  A WRITE IS SENT AS 1 RESET, 4 WRITES, 1 RESET, AND 10 IDLES;  A VERIFY IS SENT AS 3 RESETS (NMRA RECOMMENDS
+// STARTING WITH 3 RESET PACKETS) AND 5 VERIFIES (NMRA RECOMMENDS 5 VERIFY PACKETS), FOLLOWED BY 1 RESET --- THE LAST RESET IS ONLY LOADED ONCE
+// THE VERIFY PACKETS HAVE STARTED, AT WHICH POINT THE DECODER CAN RESPOND AND MONITORING OF THE CURRENT FOR AN ACKNOWLEDGEMENT BEGINS
 
-    bRead[2]=0xE8+i;  
+void RegisterList::processCV() volatile{
+  byte b[4];
+  byte n;
+  int v;
 
-    loadPacket(0,resetPacket,2,3);          // NMRA recommends starting with 3 reset packets
-    loadPacket(0,bRead,3,5);                // NMRA recommends 5 verfy packets
-    loadPacket(0,resetPacket,2,1);          // forces code to wait until all repeats of bRead are completed (and decoder begins to respond)
+  switch(cvOp.state){
 
-    for(int j=0;j<ACK_SAMPLE_COUNT;j++){
-      c=(analogRead(CURRENT_MONITOR_PIN_PROG)-base)*ACK_SAMPLE_SMOOTHING+c*(1.0-ACK_SAMPLE_SMOOTHING);
-      if(c>ACK_SAMPLE_THRESHOLD)
-        d=1;
+    case CV_STATE_IDLE:
+      return;
+
+    case CV_STATE_START:                              // keep decoder in service mode between CVs of a batch read by sending reset rather than idle packets in the background
+      if(queueDepth()>0)
+        return;
+      loadPacket(1,resetPacket,2,0);
+      cvOp.state=CV_STATE_BASE;
+      return;
+
+    case CV_STATE_END:                                // restore idle packets in the background once a batch read is done
+      if(queueDepth()>0)
+        return;
+      loadPacket(1,idlePacket,2,0);
+      cvOp.state=CV_STATE_IDLE;
+      return;
+
+    case CV_STATE_WRITE:                              // send write packets
+      if(queueDepth()>0)                              // wait until prior packet has been picked up by the interrupt routine
+        return;
+      n=cvOp.nSent++;
+      if(n==0)
+        loadPacket(0,resetPacket,2,1);
+      else if(n==1){
+        for(int i=0;i<3;i++) b[i]=cvOp.packet[i];    // loadPacket() appends the checksum, so use a copy
+        loadPacket(0,b,3,4);
+      } else if(n==2)
+        loadPacket(0,resetPacket,2,1);
+      else{
+        loadPacket(0,idlePacket,2,10);
+        if(cvOp.op==CV_OP_WRITE_BYTE)
+          cvOp.packet[0]=0x74+(highByte(cvOp.cv)&0x03);   // set-up to re-verify entire byte
+        else
+          bitClear(cvOp.packet[2],4);                     // change instruction code from Write Bit to Verify Bit
+        cvOp.nSent=0;
+        cvOp.base=0;
+        cvOp.tail=CurrentSampler::head[CURRENT_CHANNEL_PROG];     // baseline starts with the next new sample
+        cvOp.state=CV_STATE_BASE;
+      }
+      return;
+
+    case CV_STATE_BASE:                               // establish baseline current before verify
+      while(cvOp.nSamples<ACK_BASE_COUNT && (v=nextSample())>=0){
+        cvOp.base+=v;
+        cvOp.nSamples++;
+      }
+      if(cvOp.nSamples<ACK_BASE_COUNT)
+        return;
+      cvOp.base/=ACK_BASE_COUNT;
+      cvOp.nSamples=0;
+      if(cvOp.op==CV_OP_CALIBRATE){
+        cvOp.c.reset(0);
+        cvOp.bValue=0;                                // largest deviation seen so far
+        cvOp.state=CV_STATE_NOISE;
+      } else
+        cvOp.state=CV_STATE_VERIFY;
+      return;
+
+    case CV_STATE_NOISE:                              // measure noise floor of idle current
+      while(cvOp.nSamples<ACK_CALIBRATE_COUNT && (v=nextSample())>=0){
+        cvOp.bValue=max(cvOp.bValue,abs(cvOp.c.update(v-cvOp.base,FILTER_WEIGHT(ACK_SAMPLE_SMOOTHING))));
+        cvOp.nSamples++;
+      }
+      if(cvOp.nSamples<ACK_CALIBRATE_COUNT)
+        return;
+      cvOp.nSamples=0;
+      if(cvOp.base<ACK_BASE_MIN)                      // no decoder load --- keep the threshold in use
+        INTERFACE.print("<X>");
+      else{
+        AckCalibration::set(cvOp.base,cvOp.bValue,cvOp.bNum);
+        AckCalibration::show();
+      }
+      cvOp.state=CV_STATE_IDLE;
+      return;
+
+    case CV_STATE_VERIFY:                             // send verify packets
+      if(queueDepth()>0)
+        return;
+      n=cvOp.nSent++;
+      if(n==0)
+        loadPacket(0,resetPacket,2,3);
+      else if(n==1){
+        for(int i=0;i<3;i++) b[i]=cvOp.packet[i];
+        loadPacket(0,b,3,5);
+      } else{
+        loadPacket(0,resetPacket,2,1);
+        cvOp.nSent=0;
+        cvOp.c.reset(0);
+        cvOp.ack=0;
+        cvOp.pulse=0;
+        cvOp.tail=CurrentSampler::head[CURRENT_CHANNEL_PROG];     // decoder can respond from here on
+        cvOp.state=CV_STATE_ACK;
+      }
+      return;
+
+    case CV_STATE_ACK:                                // monitor current for acknowledgement
+      while(cvOp.nSamples<ACK_SAMPLE_COUNT && (v=nextSample())>=0){
+        if(cvOp.elapsed>1){                           // samples were missed --- the width of the current pulse is unknown
+          if(cvOp.nRetries++<ACK_RETRY_MAX){
+            cvOp.nSamples=0;
+            cvOp.state=CV_STATE_VERIFY;               // send the verify again
+            return;
+          }
+          cvOp.nSamples=ACK_SAMPLE_COUNT;             // too many retries --- report the operation as failed, rather than a value that may be wrong
+          cvOp.pulse=0;
+          cvOp.speculative=0;
+          if(cvOp.op==CV_OP_READ)
+            cvOp.bNum=8;
+          break;
+        }
+        cvOp.nSamples++;
+        if(cvOp.c.update(v-cvOp.base,FILTER_WEIGHT(ACK_SAMPLE_SMOOTHING))>AckCalibration::data.threshold){
+          if(cvOp.pulse>=0 && ++cvOp.pulse>ACK_PULSE_MAX/ACK_SAMPLE_MICROS)
+            cvOp.pulse=-1;                            // too long to be an acknowledgement --- ignore until current falls below threshold again
+        } else{
+          if(cvOp.pulse>=ACK_PULSE_MIN/ACK_SAMPLE_MICROS)
+            cvOp.ack=1;                               // pulse width is within acknowledgement window
+          cvOp.pulse=0;
+          if(cvOp.ack)
+            break;                                    // no need to wait for remaining samples
+        }
+      }
+      if(cvOp.ack==0 && cvOp.nSamples<ACK_SAMPLE_COUNT)
+        return;
+      if(cvOp.pulse>=ACK_PULSE_MIN/ACK_SAMPLE_MICROS)     // a pulse of valid width was still in progress when sampling ended
+        cvOp.ack=1;
+      cvOp.nSamples=0;
+      cvOp.nRetries=0;
+      break;                                          // verify complete --- process result below
+
+  } // switch
+
+  if(cvOp.op==CV_OP_READ && cvOp.speculative){        // checked remembered value
+    cvOp.speculative=0;
+    if(cvOp.ack==0){                                  // remembered value is out of date --- read bit by bit
+      cvOp.bValue=0;
+      cvOp.packet[0]=0x78+(highByte(cvOp.cv)&0x03);
+      cvOp.packet[2]=0xE8;
+      cvOp.state=CV_STATE_VERIFY;
+      return;
     }
+    cvOp.bNum=8;                                      // remembered value is confirmed --- no bits need to be read
+  }
 
-    bitWrite(bValue,i,d);
+  if(cvOp.op==CV_OP_READ && cvOp.bNum<8){             // still reading bits
+    bitWrite(cvOp.bValue,cvOp.bNum,cvOp.ack);
+    if(++cvOp.bNum<8)
+      cvOp.packet[2]=0xE8+cvOp.bNum;
+    else{
+      cvOp.packet[0]=0x74+(highByte(cvOp.cv)&0x03);   // set-up to re-verify entire byte
+      cvOp.packet[2]=cvOp.bValue;
+    }
+    cvOp.state=CV_STATE_VERIFY;                       // the baseline taken before the first bit is re-used for the whole CV
+    return;
   }
-    
-  c=0;
-  d=0;
-  base=0;
 
-  for(int j=0;j<ACK_BASE_COUNT;j++)
-    base+=analogRead(CURRENT_MONITOR_PIN_PROG);
-  base/=ACK_BASE_COUNT;
-  
-  bRead[0]=0x74+(highByte(cv)&0x03);   // set-up to re-verify entire byte
-  bRead[2]=bValue;  
+  if(cvOp.ack==0){    // verify unsuccessful
+    cvOp.bValue=-1;
+    CVCache::remove(cvOp.cv);
+  } else if(cvOp.op==CV_OP_WRITE_BIT)
+    CVCache::putBit(cvOp.cv,cvOp.bNum,cvOp.bValue);
+  else
+    CVCache::put(cvOp.cv,cvOp.bValue);
 
-  loadPacket(0,resetPacket,2,3);          // NMRA recommends starting with 3 reset packets
-  loadPacket(0,bRead,3,5);                // NMRA recommends 5 verfy packets
-  loadPacket(0,resetPacket,2,1);          // forces code to wait until all repeats of bRead are completed (and decoder begins to respond)
-    
-  for(int j=0;j<ACK_SAMPLE_COUNT;j++){
-    c=(analogRead(CURRENT_MONITOR_PIN_PROG)-base)*ACK_SAMPLE_SMOOTHING+c*(1.0-ACK_SAMPLE_SMOOTHING);
-    if(c>ACK_SAMPLE_THRESHOLD)
-      d=1;
+  printCV(cvOp.op,cvOp.cv,cvOp.bNum,cvOp.bValue,cvOp.callBack,cvOp.callBackSub);
+
+  if(cvOp.op==CV_OP_READ && cvOp.cv<cvOp.lastCV){    // move on to next cv of a batch read
+    cvOp.cv++;
+    startRead();
+    return;
   }
-    
-  if(d==0)    // verify unsuccessful
-    bValue=-1;
 
-  INTERFACE.print("<r");
-  INTERFACE.print(callBack);
-  INTERFACE.print("|");
-  INTERFACE.print(callBackSub);
-  INTERFACE.print("|");
-  INTERFACE.print(cv+1);
-  INTERFACE.print(" ");
-  INTERFACE.print(bValue);
-  INTERFACE.print(">");
-        
-} // RegisterList::readCV()
+  cvOp.state=cvOp.batch?CV_STATE_END:CV_STATE_IDLE;
+
+} // RegisterList::processCV()
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void RegisterList::writeCVByte(char *s) volatile{
-  byte bWrite[4];
-  int bValue;
-  int c,d,base;
-  int cv, callBack, callBackSub;
+// RETURNS THE NEXT PROGRAMMING TRACK CURRENT SAMPLE FROM THE ADC SAMPLER, OR -1 IF NONE IS WAITING, AND SETS cvOp.elapsed TO THE NUMBER
+// OF SAMPLE PERIODS SINCE THE LAST SAMPLE READ (MORE THAN 1 ONLY IF loop() WAS TOO SLOW AND SAMPLES WERE OVERWRITTEN BEFORE BEING READ)
 
-  if(sscanf(s,"%d %d %d %d",&cv,&bValue,&callBack,&callBackSub)!=4)          // cv = 1-1024
-    return;    
-  cv--;                              // actual CV addresses are cv-1 (0-1023)
-  
-  bWrite[0]=0x7C+(highByte(cv)&0x03);   // any CV>1023 will become modulus(1024) due to bit-mask of 0x03
-  bWrite[1]=lowByte(cv);
-  bWrite[2]=bValue;
-
-  loadPacket(0,resetPacket,2,1);
-  loadPacket(0,bWrite,3,4);
-  loadPacket(0,resetPacket,2,1);
-  loadPacket(0,idlePacket,2,10);
-
-  c=0;
-  d=0;
-  base=0;
-
-  for(int j=0;j<ACK_BASE_COUNT;j++)
-    base+=analogRead(CURRENT_MONITOR_PIN_PROG);
-  base/=ACK_BASE_COUNT;
-  
-  bWrite[0]=0x74+(highByte(cv)&0x03);   // set-up to re-verify entire byte
+int RegisterList::nextSample() volatile{
+  byte t=cvOp.tail;
+  int v=CurrentSampler::read(CURRENT_CHANNEL_PROG,&t);
 
-  loadPacket(0,resetPacket,2,3);          // NMRA recommends starting with 3 reset packets
-  loadPacket(0,bWrite,3,5);               // NMRA recommends 5 verfy packets
-  loadPacket(0,resetPacket,2,1);          // forces code to wait until all repeats of bRead are completed (and decoder begins to respond)
-    
-  for(int j=0;j<ACK_SAMPLE_COUNT;j++){
-    c=(analogRead(CURRENT_MONITOR_PIN_PROG)-base)*ACK_SAMPLE_SMOOTHING+c*(1.0-ACK_SAMPLE_SMOOTHING);
-    if(c>ACK_SAMPLE_THRESHOLD)
-      d=1;
+  cvOp.elapsed=t-cvOp.tail;
+  cvOp.tail=t;
+  return(v);
+} // RegisterList::nextSample()
+
+///////////////////////////////////////////////////////////////////////////////
+
+// STOPS A READ IN PROGRESS, INCLUDING ANY REMAINING CVS OF A BATCH READ.  NO <r> RESPONSE IS SENT FOR THE CV THAT WAS BEING READ
+
+void RegisterList::cancelCV() volatile{
+
+  if(cvOp.state==CV_STATE_IDLE || cvOp.state==CV_STATE_END || cvOp.op!=CV_OP_READ){      // nothing to cancel --- writes are always allowed to complete
+    INTERFACE.print("<X>");
+    return;
   }
-    
-  if(d==0)    // verify unsuccessful
-    bValue=-1;
 
+  cvOp.state=cvOp.batch?CV_STATE_END:CV_STATE_IDLE;
+  INTERFACE.print("<O>");
+
+} // RegisterList::cancelCV()
+
+///////////////////////////////////////////////////////////////////////////////
+
+void RegisterList::printCV(byte op, int cv, int bNum, int bValue, int callBack, int callBackSub) volatile{
   INTERFACE.print("<r");
   INTERFACE.print(callBack);
   INTERFACE.print("|");
@@ -333,83 +1023,180 @@ void RegisterList::writeCVByte(char *s) volatile{
   INTERFACE.print("|");
   INTERFACE.print(cv+1);
   INTERFACE.print(" ");
+  if(op==CV_OP_WRITE_BIT){
+    INTERFACE.print(bNum);
+    INTERFACE.print(" ");
+  }
   INTERFACE.print(bValue);
   INTERFACE.print(">");
-
-} // RegisterList::writeCVByte()
+} // RegisterList::printCV()
   
 ///////////////////////////////////////////////////////////////////////////////
 
-void RegisterList::writeCVBit(char *s) volatile{
-  byte bWrite[4];
-  int bNum,bValue;
-  int c,d,base;
-  int cv, callBack, callBackSub;
+// THE ACKNOWLEDGEMENT THRESHOLD CAN BE CALIBRATED TO THE PROGRAMMING TRACK BY MEASURING THE IDLE CURRENT (WITH THE ENGINE ON THE TRACK AND ONLY
+// IDLE PACKETS BEING SENT) AND THE LARGEST DEVIATION OF THE SMOOTHED SAMPLES FROM IT.  SOUND DECODERS AND LIGHTED CARS RAISE THIS NOISE FLOOR,
+// AND THE THRESHOLD IS SET ABOVE IT WITH A MARGIN, BUT NEVER BELOW THE DEFAULT ACK_SAMPLE_THRESHOLD UNLESS <A 2> ASKS FOR A THRESHOLD AS LOW AS
+// ACK_THRESHOLD_MIN.  IF THE IDLE CURRENT IS BELOW ACK_BASE_MIN THERE IS NO DECODER TO CALIBRATE AGAINST (THE TRACK IS OFF, OR EMPTY), SO THE
+// CALIBRATION IS REFUSED AND THE THRESHOLD IN USE IS KEPT.  CALIBRATION RUNS AS A STEP OF THE CV STATE MACHINE, AND IS SAVED TO EEPROM, AFTER
+// THE OUTPUTS, WITH THE <E> COMMAND.
 
-  if(sscanf(s,"%d %d %d %d %d",&cv,&bNum,&bValue,&callBack,&callBackSub)!=5)          // cv = 1-1024
-    return;    
-  cv--;                              // actual CV addresses are cv-1 (0-1023)
-  bValue=bValue%2;
-  bNum=bNum%8;
-  
-  bWrite[0]=0x78+(highByte(cv)&0x03);   // any CV>1023 will become modulus(1024) due to bit-mask of 0x03
-  bWrite[1]=lowByte(cv);  
-  bWrite[2]=0xF0+bValue*8+bNum;
-
-  loadPacket(0,resetPacket,2,1);
-  loadPacket(0,bWrite,3,4);
-  loadPacket(0,resetPacket,2,1);
-  loadPacket(0,idlePacket,2,10);
-
-  c=0;
-  d=0;
-  base=0;
-
-  for(int j=0;j<ACK_BASE_COUNT;j++)
-    base+=analogRead(CURRENT_MONITOR_PIN_PROG);
-  base/=ACK_BASE_COUNT;
-  
-  bitClear(bWrite[2],4);              // change instruction code from Write Bit to Verify Bit
+void RegisterList::calibrateAck(int *p, int nParams) volatile{
 
-  loadPacket(0,resetPacket,2,3);          // NMRA recommends starting with 3 reset packets
-  loadPacket(0,bWrite,3,5);               // NMRA recommends 5 verfy packets
-  loadPacket(0,resetPacket,2,1);          // forces code to wait until all repeats of bRead are completed (and decoder begins to respond)
-    
-  for(int j=0;j<ACK_SAMPLE_COUNT;j++){
-    c=(analogRead(CURRENT_MONITOR_PIN_PROG)-base)*ACK_SAMPLE_SMOOTHING+c*(1.0-ACK_SAMPLE_SMOOTHING);
-    if(c>ACK_SAMPLE_THRESHOLD)
-      d=1;
+  switch(nParams){
+
+    case 0:                    // no arguments --- show calibration
+      AckCalibration::show();
+      break;
+
+    case 1:
+      if(p[0]==0){              // restore default threshold
+        AckCalibration::reset();
+        AckCalibration::show();
+      } else if(cvOp.state!=CV_STATE_IDLE || p[0]>2)     // programming track is busy, or invalid argument
+        INTERFACE.print("<X>");
+      else{                     // calibrate --- response is printed when done
+        cvOp.op=CV_OP_CALIBRATE;
+        cvOp.bNum=(p[0]==2)?ACK_THRESHOLD_MIN:ACK_SAMPLE_THRESHOLD;    // lowest threshold calibration may set
+        cvOp.nSamples=0;
+        cvOp.base=0;
+        cvOp.tail=CurrentSampler::head[CURRENT_CHANNEL_PROG];     // baseline starts with the next new sample
+        cvOp.state=CV_STATE_BASE;
+      }
+      break;
+
+    default:
+      INTERFACE.print("<X>");
+      break;
   }
-    
-  if(d==0)    // verify unsuccessful
-    bValue=-1;
-  
-  INTERFACE.print("<r");
-  INTERFACE.print(callBack);
-  INTERFACE.print("|");
-  INTERFACE.print(callBackSub);
-  INTERFACE.print("|");
-  INTERFACE.print(cv+1);
+
+} // RegisterList::calibrateAck()
+
+///////////////////////////////////////////////////////////////////////////////
+
+void AckCalibration::set(int base, int noise, int minThreshold){
+  data.id=ACK_CALIBRATION_ID;
+  data.base=base;
+  data.noise=noise;
+  data.threshold=constrain(noise*2+ACK_NOISE_MARGIN,minThreshold,ACK_THRESHOLD_MAX);
+} // AckCalibration::set
+
+///////////////////////////////////////////////////////////////////////////////
+
+void AckCalibration::reset(){
+  data.id=0;
+  data.base=0;
+  data.noise=0;
+  data.threshold=ACK_SAMPLE_THRESHOLD;
+} // AckCalibration::reset
+
+///////////////////////////////////////////////////////////////////////////////
+
+void AckCalibration::show(){
+  INTERFACE.print("<k");
+  INTERFACE.print(data.base);
   INTERFACE.print(" ");
-  INTERFACE.print(bNum);
+  INTERFACE.print(data.noise);
   INTERFACE.print(" ");
-  INTERFACE.print(bValue);
+  INTERFACE.print(data.threshold);
   INTERFACE.print(">");
+} // AckCalibration::show
+
+///////////////////////////////////////////////////////////////////////////////
+
+void AckCalibration::load(){
+  EEPROM.get(EEStore::pointer(),data);
+  if(data.id!=ACK_CALIBRATION_ID || data.threshold<ACK_THRESHOLD_MIN || data.threshold>ACK_THRESHOLD_MAX)     // no valid calibration stored
+    reset();
+  EEStore::advance(sizeof(data));
+} // AckCalibration::load
 
-} // RegisterList::writeCVBit()
-  
 ///////////////////////////////////////////////////////////////////////////////
 
-void RegisterList::writeCVByteMain(char *s) volatile{
+void AckCalibration::store(){
+  EEPROM.put(EEStore::pointer(),data);
+  EEStore::advance(sizeof(data));
+} // AckCalibration::store
+
+///////////////////////////////////////////////////////////////////////////////
+
+AckCalibrationData AckCalibration::data={0,0,0,ACK_SAMPLE_THRESHOLD};
+
+///////////////////////////////////////////////////////////////////////////////
+
+// CVCache REMEMBERS THE VALUES OF RECENTLY READ OR WRITTEN CVS ON THE PROGRAMMING TRACK, KEYED BY THE ADDRESS (CV1) OF THE DECODER THEY
+// CAME FROM.  THE ADDRESS IS TAKEN FROM THE LAST VALUE OF CV1 READ OR WRITTEN, SO WHEN A DIFFERENT ENGINE IS PLACED ON THE TRACK THE FIRST
+// READ OF CV1 FAILS ITS VERIFY, AND ALL FURTHER ENTRIES ARE KEPT UNDER THE NEW ADDRESS.  A CACHED VALUE IS ONLY EVER USED AS A GUESS THAT
+// IS CHECKED WITH A VERIFY-BYTE, SO A STALE ENTRY COSTS ONE EXTRA VERIFY BUT NEVER RETURNS A WRONG VALUE.  ENTRIES ARE REPLACED IN ROTATION.
+
+int CVCache::get(int cv){
+  for(int i=0;i<CV_CACHE_SIZE;i++)
+    if(entry[i].cv==cv+1 && entry[i].address==address)
+      return(entry[i].value);
+  return(-1);
+} // CVCache::get
+
+///////////////////////////////////////////////////////////////////////////////
+
+void CVCache::put(int cv, int value){
+  int i;
+
+  if(cv==0)                       // CV1 holds the short address of the decoder
+    address=value;
+
+  for(i=0;i<CV_CACHE_SIZE;i++)
+    if(entry[i].cv==cv+1 && entry[i].address==address)
+      break;
+
+  if(i==CV_CACHE_SIZE){           // not found --- replace next entry in rotation
+    i=next;
+    next=(next+1)%CV_CACHE_SIZE;
+  }
+
+  entry[i].address=address;
+  entry[i].cv=cv+1;
+  entry[i].value=value;
+} // CVCache::put
+
+///////////////////////////////////////////////////////////////////////////////
+
+void CVCache::putBit(int cv, int bNum, int bValue){
+  int v=get(cv);
+
+  if(v<0)                         // other bits are not known
+    return;
+  bitWrite(v,bNum,bValue);
+  put(cv,v);
+} // CVCache::putBit
+
+///////////////////////////////////////////////////////////////////////////////
+
+void CVCache::remove(int cv){
+  for(int i=0;i<CV_CACHE_SIZE;i++)
+    if(entry[i].cv==cv+1 && entry[i].address==address)
+      entry[i].cv=0;
+} // CVCache::remove
+
+///////////////////////////////////////////////////////////////////////////////
+
+CVCacheEntry CVCache::entry[CV_CACHE_SIZE];
+int CVCache::address=0;
+byte CVCache::next=0;
+
+///////////////////////////////////////////////////////////////////////////////
+
+void RegisterList::writeCVByteMain(int *p, int nParams) volatile{
   byte b[6];                      // save space for checksum byte
   int cab;
   int cv;
   int bValue;
   byte nB=0;
   
-  if(sscanf(s,"%d %d %d",&cab,&cv,&bValue)!=3)
+  if(nParams!=3)
     return;
-  cv--;
+
+  cab=p[0];
+  cv=p[1]-1;
+  bValue=p[2];
 
   if(cab>127)    
     b[nB++]=highByte(cab) | 0xC0;      // convert train number into a two-byte address
@@ -425,7 +1212,7 @@ void RegisterList::writeCVByteMain(char *s) volatile{
   
 ///////////////////////////////////////////////////////////////////////////////
 
-void RegisterList::writeCVBitMain(char *s) volatile{
+void RegisterList::writeCVBitMain(int *p, int nParams) volatile{
   byte b[6];                      // save space for checksum byte
   int cab;
   int cv;
@@ -433,12 +1220,13 @@ void RegisterList::writeCVBitMain(char *s) volatile{
   int bValue;
   byte nB=0;
   
-  if(sscanf(s,"%d %d %d %d",&cab,&cv,&bNum,&bValue)!=4)
+  if(nParams!=4)
     return;
-  cv--;
-    
-  bValue=bValue%2;
-  bNum=bNum%8; 
+
+  cab=p[0];
+  cv=p[1]-1;
+  bNum=p[2]%8;
+  bValue=p[3]%2;
 
   if(cab>127)    
     b[nB++]=highByte(cab) | 0xC0;      // convert train number into a two-byte address
@@ -454,6 +1242,104 @@ void RegisterList::writeCVBitMain(char *s) volatile{
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// ADVANCED CONSISTS ARE FORMED BY WRITING THE CONSIST ADDRESS INTO CV19 OF EACH MEMBER ON THE MAIN OPERATIONS TRACK (BIT 7 SET
+// IF THE MEMBER RUNS REVERSED).  EACH DECODER THEN ANSWERS SPEED AND DIRECTION PACKETS SENT TO THE CONSIST ADDRESS, SO A SINGLE
+// THROTTLE REGISTER DRIVES THE WHOLE CONSIST.  consistTable RECORDS THE MEMBERS SET BY THIS BASE STATION SINCE POWER-UP.
+
+void RegisterList::setConsist(int *p, int nParams) volatile{
+  int consist, cab, direction;
+  int nReg;
+  int c[4];
+  byte b[5];                      // save space for checksum byte
+  byte nB;
+  ConsistMember *m;
+
+  switch(nParams){
+
+    case 3:                     // add CAB to CONSIST
+      consist=p[0];
+      cab=p[1];
+      direction=p[2];
+      if(consist<1 || consist>127 || cab<1 || cab>10293){
+        INTERFACE.print("<X>");
+        return;
+      }
+      if((m=getConsistMember(cab))==NULL)
+        m=getConsistMember(0);                 // find free entry
+      if(m==NULL){
+        INTERFACE.print("<X>");
+        return;
+      }
+      if((nReg=findCab(cab))>0){               // cab's own register is no longer needed --- stop it, so that it does not start moving when removed from consist, and release register for re-use
+        nB=0;
+        if(cab>127)
+          b[nB++]=highByte(cab) | 0xC0;        // convert train number into a two-byte address
+        b[nB++]=lowByte(cab);
+        b[nB++]=0x3F;                          // 128-step speed control byte
+        b[nB++]=(speedTable[nReg]>=0)*128;     // speed 0, keeping the current direction
+        loadPacket(0,b,nB,4);                  // stop the cab with one-time packets, without a <T> reply
+        releaseCab(nReg);
+      }
+      m->cab=cab;
+      m->consist=consist;
+      m->direction=(direction!=0);
+      c[0]=cab;
+      c[1]=19;
+      c[2]=consist+(direction==0?0x80:0);
+      writeCVByteMain(c,3);
+      INTERFACE.print("<O>");
+      break;
+
+    case 1:                     // remove CAB (the only argument) from its consist
+      cab=p[0];
+      if(cab<1 || cab>10293 || (m=getConsistMember(cab))==NULL){
+        INTERFACE.print("<X>");
+        return;
+      }
+      m->cab=0;
+      c[0]=cab;
+      c[1]=19;
+      c[2]=0;
+      writeCVByteMain(c,3);
+      INTERFACE.print("<O>");
+      break;
+
+    case 0:                     // no arguments --- list consist members
+      nReg=0;
+      for(int i=0;i<maxConsistMembers;i++){
+        if(consistTable[i].cab==0)
+          continue;
+        INTERFACE.print("<U");
+        INTERFACE.print(consistTable[i].consist);
+        INTERFACE.print(" ");
+        INTERFACE.print(consistTable[i].cab);
+        INTERFACE.print(" ");
+        INTERFACE.print(consistTable[i].direction);
+        INTERFACE.print(">");
+        nReg++;
+      }
+      if(nReg==0)
+        INTERFACE.print("<X>");
+      break;
+
+    default:                    // invalid number of arguments
+      INTERFACE.print("<X>");
+      break;
+  }
+
+} // RegisterList::setConsist()
+
+///////////////////////////////////////////////////////////////////////////////
+
+ConsistMember *RegisterList::getConsistMember(int cab) volatile{
+  for(int i=0;i<maxConsistMembers;i++)
+    if(consistTable[i].cab==cab)
+      return(consistTable+i);
+  return(NULL);
+} // RegisterList::getConsistMember()
+
+///////////////////////////////////////////////////////////////////////////////
+
 void RegisterList::printPacket(int nReg, byte *b, int nBytes, int nRepeat) volatile {
   
   INTERFACE.print("<*");
@@ -472,5 +1358,3 @@ void RegisterList::printPacket(int nReg, byte *b, int nBytes, int nRepeat) volat
 
 byte RegisterList::idlePacket[3]={0xFF,0x00,0};                 // always leave extra byte for checksum computation
 byte RegisterList::resetPacket[3]={0x00,0x00,0};
-
-byte RegisterList::bitMask[]={0x80,0x40,0x20,0x10,0x08,0x04,0x02,0x01};         // masks used in interrupt routine to speed the query of a single bit in a Packet
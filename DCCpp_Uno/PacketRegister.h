@@ -11,6 +11,7 @@ Part of DCC++ BASE STATION for the Arduino
 #define PacketRegister_h
 
 #include "Arduino.h"
+#include "Filter.h"
 
 // Define constants used for reading CVs from the Programming Track
 
@@ -18,6 +19,75 @@ Part of DCC++ BASE STATION for the Arduino
 #define  ACK_SAMPLE_COUNT          500      // number of analogRead samples to take when monitoring current after a CV verify (bit or byte) has been sent 
 #define  ACK_SAMPLE_SMOOTHING      0.2      // exponential smoothing to use in processing the analogRead samples after a CV verify (bit or byte) has been sent
 #define  ACK_SAMPLE_THRESHOLD       30      // the threshold that the exponentially-smoothed analogRead samples (after subtracting the baseline current) must cross to establish ACKNOWLEDGEMENT
+#define  ACK_SAMPLE_MICROS         108      // time between Programming Track samples from CurrentSampler, in microseconds (two channels of 13.5 ADC clocks at 4 microseconds each)
+#define  ACK_PULSE_MIN            4000      // shortest time, in microseconds, the smoothed samples must stay above ACK_SAMPLE_THRESHOLD to count as an ACKNOWLEDGEMENT (NMRA specifies 6 ms +/- 1 ms, less smoothing delay)
+#define  ACK_PULSE_MAX            9000      // longest time, in microseconds, the smoothed samples may stay above ACK_SAMPLE_THRESHOLD to count as an ACKNOWLEDGEMENT (NMRA specifies 6 ms +/- 1 ms, plus smoothing delay)
+#define  ACK_RETRY_MAX                3      // number of times a verify is sent again because loop() missed current samples while waiting for an ACKNOWLEDGEMENT, before the operation fails
+
+// Define the number of recently read or written CVs remembered for the Programming Track
+
+#ifdef ARDUINO_AVR_UNO                        // Configuration for UNO
+  #define  CV_CACHE_SIZE            16
+#else                                         // Configuration for MEGA
+  #define  CV_CACHE_SIZE            64
+#endif
+
+// Define constants used for calibrating the acknowledgement threshold to the idle current of the Programming Track
+
+#define  ACK_CALIBRATE_COUNT      1000      // number of current samples taken to measure the noise floor
+#define  ACK_NOISE_MARGIN           10      // amount added to twice the noise floor to give the acknowledgement threshold
+#define  ACK_BASE_MIN                5      // lowest idle current, in analogRead counts, taken to show that a decoder is on a powered Programming Track
+#define  ACK_THRESHOLD_MIN          10      // lowest acknowledgement threshold that calibration may set, and only if asked for with <A 2> --- <A 1> stays at or above ACK_SAMPLE_THRESHOLD
+#define  ACK_THRESHOLD_MAX          60      // highest acknowledgement threshold that calibration may set
+#define  ACK_CALIBRATION_ID       0xAC      // marks a valid calibration record in EEPROM
+
+// Define the operations and states of the Programming Track CV state machine
+
+#define  CV_OP_READ                  0
+#define  CV_OP_WRITE_BYTE            1
+#define  CV_OP_WRITE_BIT             2
+#define  CV_OP_CALIBRATE             3
+
+#define  CV_STATE_IDLE               0      // no CV operation in progress
+#define  CV_STATE_WRITE              1      // loading write packets
+#define  CV_STATE_BASE               2      // sampling baseline current ahead of a verify
+#define  CV_STATE_VERIFY             3      // loading verify packets
+#define  CV_STATE_ACK                4      // sampling current for an acknowledgement from the decoder
+#define  CV_STATE_START              5      // loading reset packets into register 1 before a batch read
+#define  CV_STATE_END                6      // restoring idle packets in register 1 after a batch read
+#define  CV_STATE_NOISE              7      // sampling idle current to measure noise floor for calibration
+
+// Define the depth of the queue of pending Register updates waiting to be picked up by the interrupt routine
+
+#define  MAIN_UPDATE_QUEUE_SIZE      8      // number of updates that can be waiting for the Main Track before loadPacket() pauses
+#define  PROG_UPDATE_QUEUE_SIZE      1      // the Programming Track keeps a single slot --- the CV routines rely on loadPacket() pausing until the prior packet has started
+
+// Define the number of additional times a newly-changed packet in a permanent Register is sent ahead of the background refresh cycle
+
+#define  PRIORITY_REFRESH_COUNT      3
+
+// Define the largest number of packets for newly-changed permanent Registers (taken from the update queue or re-sent ahead of the background
+// refresh cycle) that are sent in a row before one packet of the background refresh cycle must be sent, so that the refresh cycle is never starved
+
+#define  PRIORITY_BURST_MAX          2
+
+// Define the number of broadcast (or single-cab) emergency stop packets sent ahead of everything else when an emergency stop is requested
+
+#define  ESTOP_REPEAT_COUNT          5
+
+// Define the cabTable entry of a Register holding a raw packet written with <M>, which automatic register selection never takes over
+
+#define  CAB_RAW                    -1
+
+// Define constants used for refreshing stored cab function settings on the Main Track
+
+#define  FUNCTION_GROUPS             5      // FL,F1-F4 / F5-F8 / F9-F12 / F13-F20 / F21-F28
+
+#ifdef ARDUINO_AVR_UNO                        // Configuration for UNO
+  #define  FUNCTION_REFRESH_TIME    350      // time between function group refreshes (~50 ms, since millis() runs fast when TIMER-0 is used for the Programming Track)
+#else                                         // Configuration for MEGA    
+  #define  FUNCTION_REFRESH_TIME     50      // time between function group refreshes, in milliseconds
+#endif
 
 // Define a series of registers that can be sequentially accessed over a loop to generate a repeating series of DCC Packets
 
@@ -27,38 +97,176 @@ struct Packet{
 }; // Packet
 
 struct Register{
-  Packet packet[2];
+  Packet packet;
   Packet *activePacket;
-  Packet *updatePacket;
+  byte nPriority;
+  unsigned int lastSent;            // value of packetCount when this Register was last sent
+  unsigned int lastInterval;        // number of packets sent on the track between the last two sends of this Register
+  unsigned int maxInterval;         // largest such interval since telemetry was last reported
   void initPackets();
 }; // Register
+
+struct FunctionState{
+  byte group[FUNCTION_GROUPS];      // last instruction byte sent for groups FL,F1-F4 through F9-F12, or last data byte sent for groups F13-F20 and F21-F28
+  byte groupMask;                   // bit n is set once group n has been set for this cab
+}; // FunctionState
+
+#define  MAX_CONSIST_MEMBERS         8      // number of cabs that can be recorded as members of advanced consists
+
+struct ConsistMember{
+  int cab;                          // member cab address, or 0 if entry is free
+  byte consist;                     // consist address (1-127) written into CV19 of the member
+  byte direction;                   // 1=member runs in normal direction, 0=member runs reversed
+}; // ConsistMember
+
+#define  ISR_TIMING_BUCKETS          8      // number of 32-cycle buckets in histogram of interrupt times (used only when ISR_TIMING is set)
+
+struct IsrTiming{
+  unsigned long count;
+  unsigned long totalCycles;
+  unsigned int minCycles;
+  unsigned int maxCycles;
+  unsigned int maxLatency;
+  unsigned long lateCount;
+  unsigned long histogram[ISR_TIMING_BUCKETS];
+  void record(unsigned int, unsigned int, unsigned int, byte);
+  void show(const char *);
+}; // IsrTiming
+
+struct CVCacheEntry{
+  int address;                      // address (CV1) of the decoder the value came from
+  int cv;                           // actual CV address plus 1 (1-1024), or 0 if entry is unused
+  byte value;
+}; // CVCacheEntry
+
+struct CVCache{
+  static CVCacheEntry entry[CV_CACHE_SIZE];
+  static int address;
+  static byte next;
+  static int get(int);
+  static void put(int, int);
+  static void putBit(int, int, int);
+  static void remove(int);
+}; // CVCache
+
+struct AckCalibrationData{
+  byte id;                          // ACK_CALIBRATION_ID if calibration has been stored
+  int base;                         // idle current of the Programming Track
+  int noise;                        // largest smoothed deviation from idle current
+  int threshold;                    // acknowledgement threshold in use
+}; // AckCalibrationData
+
+struct AckCalibration{
+  static AckCalibrationData data;
+  static void set(int, int, int);
+  static void reset();
+  static void show();
+  static void load();
+  static void store();
+}; // AckCalibration
+
+struct CVOperation{
+  byte op;                          // CV_OP_READ, CV_OP_WRITE_BYTE, or CV_OP_WRITE_BIT
+  byte state;                       // CV_STATE_IDLE if no operation is in progress
+  int cv;                           // actual CV address (0-1023)
+  int lastCV;                       // last CV address of a batch read
+  byte batch;                       // set if register 1 sends reset packets (for a batch read, or an operation started right after one) until done
+  byte speculative;                 // set while checking a remembered value with a verify-byte, before reading bit by bit
+  int bNum;                         // bit to write, or next bit to verify when reading
+  int bValue;                       // value to write, or value read so far
+  int callBack;
+  int callBackSub;
+  byte packet[3];                   // write or verify instruction, without checksum
+  byte nSent;                       // number of packets of the current sequence already loaded
+  byte nRetries;                    // number of times the current verify has been sent again because current samples were missed
+  int nSamples;                     // number of current samples taken so far for the baseline or acknowledgement
+  long base;                        // baseline current
+  ExpFilter c;                      // smoothed current above baseline
+  byte ack;                         // set if an acknowledgement was detected
+  int pulse;                        // number of samples so far above threshold, or -1 if the current pulse is too long to be an acknowledgement
+  byte tail;                        // sequence number of next Programming Track sample to read from CurrentSampler
+  byte elapsed;                     // number of sample periods since the previous sample read
+}; // CVOperation
+
+struct RegisterUpdate{
+  Register *reg;
+  Packet *packet;
+  byte nRepeat;
+}; // RegisterUpdate
   
 struct RegisterList{  
   int maxNumRegs;
+  byte preambleBits;
   Register *reg;
   Register **regMap;
   Register *currentReg;
-  Register *maxLoadedReg;
-  Register *nextReg;
+  Register *maxLoadedReg;           // last Register in the background refresh cycle, set by the interrupt routine when it takes a Register's first update from the queue
+  Register *maxMappedReg;           // last Register given to a Register Number by loadPacket(), which may still be waiting in the queue
+  RegisterUpdate *updateQueue;
+  byte queueSize;
+  byte queueHead;
+  byte queueTail;
+  byte queueMaxDepth;
+  unsigned int queueFullCount;
+  Register **priorityRegs;
+  byte priorityHead;
+  byte priorityTail;
+  byte nBurst;                      // packets sent in a row for newly-changed permanent Registers since the last background refresh packet
+  Register *refreshReg;
+  unsigned long packetCount;
+  unsigned long oneShotCount;
   Packet  *tempPacket;
-  byte currentBit;
+  byte *currentByte;
+  byte currentMask;
+  byte bitsLeft;
   byte nRepeat;
+  Register *stopReg;
+  byte nStop;
   int *speedTable;
+  int *cabTable;
+  byte *cabIndex;
+  byte nCabs;
+  unsigned int *lastCommand;
+  unsigned int commandCount;
+  FunctionState *functionTable;
+  byte functionReg;
+  byte functionGroup;
+  unsigned long functionTime;
+  byte maxConsistMembers;
+  ConsistMember *consistTable;
+  CVOperation cvOp;
   static byte idlePacket[];
   static byte resetPacket[];
-  static byte bitMask[];
-  RegisterList(int);
+  RegisterList(int, int, int, int=0);
+  void buildPacket(Packet *, byte *, int) volatile;
   void loadPacket(int, byte *, int, int, int=0) volatile;
-  void setThrottle(char *) volatile;
-  void setFunction(char *) volatile;  
-  void setAccessory(char *) volatile;
-  void writeTextPacket(char *) volatile;
-  void readCV(char *) volatile;
-  void writeCVByte(char *) volatile;
-  void writeCVBit(char *) volatile;
-  void writeCVByteMain(char *) volatile;
-  void writeCVBitMain(char *s) volatile;  
+  void emergencyStop(int *, int) volatile;
+  void setThrottle(int *, int) volatile;
+  int findCab(int) volatile;
+  void setCab(int, int) volatile;
+  int allocateCab(int) volatile;
+  void releaseCab(int) volatile;
+  void setFunction(int *, int) volatile;  
+  void refreshFunctions() volatile;
+  void setAccessory(int *, int) volatile;
+  void writeTextPacket(int *, int) volatile;
+  void readCV(int *, int) volatile;
+  void writeCVByte(int *, int) volatile;
+  void writeCVBit(int *, int) volatile;
+  int startCV(byte, int, int, int, int, int) volatile;
+  void processCV() volatile;
+  void cancelCV() volatile;
+  void calibrateAck(int *, int) volatile;
+  void startRead() volatile;
+  int nextSample() volatile;
+  void printCV(byte, int, int, int, int, int) volatile;
+  void writeCVByteMain(int *, int) volatile;
+  void writeCVBitMain(int *, int) volatile;  
+  void setConsist(int *, int) volatile;
+  ConsistMember *getConsistMember(int) volatile;
   void printPacket(int, byte *, int, int) volatile;
+  byte queueDepth() volatile;
+  void showTelemetry(const char *) volatile;
 };
 
 #endif
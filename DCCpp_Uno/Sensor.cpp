@@ -67,14 +67,14 @@ void Sensor::check(){
   Sensor *tt;
 
   for(tt=firstSensor;tt!=NULL;tt=tt->nextSensor){
-    tt->signal=tt->signal*(1.0-SENSOR_DECAY)+digitalRead(tt->data.pin)*SENSOR_DECAY;
+    tt->signal.update(digitalRead(tt->data.pin)*SENSOR_SCALE,FILTER_WEIGHT(SENSOR_DECAY));
     
-    if(!tt->active && tt->signal<0.5){
+    if(!tt->active && tt->signal.get()<SENSOR_SCALE*5/10){
       tt->active=true;
       INTERFACE.print("<Q");
       INTERFACE.print(tt->data.snum);
       INTERFACE.print(">");
-    } else if(tt->active && tt->signal>0.9){
+    } else if(tt->active && tt->signal.get()>SENSOR_SCALE*9/10){
       tt->active=false;
       INTERFACE.print("<q");
       INTERFACE.print(tt->data.snum);
@@ -110,7 +110,7 @@ Sensor *Sensor::create(int snum, int pin, int pullUp, int v){
   tt->data.pin=pin;
   tt->data.pullUp=(pullUp==0?LOW:HIGH);
   tt->active=false;
-  tt->signal=1;
+  tt->signal.reset(SENSOR_SCALE);
   pinMode(pin,INPUT);         // set mode to input
   digitalWrite(pin,pullUp);   // don't use Arduino's internal pull-up resistors for external infrared sensors --- each sensor must have its own 1K external pull-up resistor
 
@@ -189,11 +189,11 @@ void Sensor::status(){
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void Sensor::parse(char *c){
-  int n,s,m;
+void Sensor::parse(int *p, int nParams){
+  int n=p[0],s=p[1],m=p[2];
   Sensor *t;
   
-  switch(sscanf(c,"%d %d %d",&n,&s,&m)){
+  switch(nParams){
     
     case 3:                     // argument is string with id number of sensor followed by a pin number and pullUp indicator (0=LOW/1=HIGH)
       create(n,s,m,1);
@@ -203,7 +203,7 @@ void Sensor::parse(char *c){
       remove(n);
     break;
     
-    case -1:                    // no arguments
+    case 0:                     // no arguments
       show();
     break;
 
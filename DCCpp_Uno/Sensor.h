@@ -11,8 +11,10 @@ Part of DCC++ BASE STATION for the Arduino
 #define Sensor_h
 
 #include "Arduino.h"
+#include "Filter.h"
 
 #define  SENSOR_DECAY  0.03
+#define  SENSOR_SCALE  100         // smoothed sensor signal runs from 0 (LOW) to SENSOR_SCALE (HIGH)
 
 struct SensorData {
   int snum;
@@ -24,7 +26,7 @@ struct Sensor{
   static Sensor *firstSensor;
   SensorData data;
   boolean active;
-  float signal;
+  ExpFilter signal;
   Sensor *nextSensor;
   static void load();
   static void store();
@@ -33,7 +35,7 @@ struct Sensor{
   static void remove(int);  
   static void show();
   static void status();
-  static void parse(char *c);
+  static void parse(int *, int);
   static void check();   
 }; // Sensor
 
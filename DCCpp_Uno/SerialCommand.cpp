@@ -12,7 +12,19 @@ Part of DCC++ BASE STATION for the Arduino
 // ARE REQUIRED.  SPACES ANYWHERE ELSE ARE IGNORED.  A SPACE BETWEEN THE SINGLE-CHARACTER
 // COMMAND AND THE FIRST PARAMETER IS ALSO NOT REQUIRED.
 
-// See SerialCommand::parse() below for defined text commands.
+// OPTIONALLY, THE SAME COMMANDS CAN BE SENT AS COMPACT BINARY FRAMES, WHICH MAY BE FREELY MIXED WITH TEXT COMMANDS:
+//
+//   BINARY_START_BYTE  LENGTH  COMMAND  PARAMETERS...  CRC
+//
+// LENGTH IS THE NUMBER OF BYTES IN COMMAND AND PARAMETERS.  COMMAND IS THE SAME SINGLE CHARACTER USED IN THE TEXT COMMAND.
+// EACH PARAMETER IS PACKED INTO 1-3 BYTES: THE VALUE IS ZIG-ZAG ENCODED (0,-1,1,-2,2... BECOME 0,1,2,3,4...) AND SENT 7 BITS AT A TIME,
+// LEAST SIGNIFICANT FIRST, WITH BIT 7 SET IN EVERY BYTE BUT THE LAST.  THE ENCODED VALUE MUST FIT IN 16 BITS, SO A THIRD BYTE IS AT MOST 3.  CRC IS THE CRC-8 (POLYNOMIAL 0x07, INITIAL VALUE 0) OF LENGTH,
+// COMMAND, AND PARAMETERS.  FOR EXAMPLE, <t 1 3 64 1> IS SENT AS: FE 06 74 02 06 80 01 02 1B.
+//
+// A BINARY FRAME IS CARRIED OUT BY THE SAME HANDLERS AS THE TEXT COMMAND, AND GETS THE SAME TEXT RESPONSE.  A FRAME WITH AN INVALID
+// LENGTH, CRC, OR PARAMETERS IS NOT CARRIED OUT, AND RETURNS <X>.
+
+// See SerialCommand::execute() below for defined text commands.
 
 #include "SerialCommand.h"
 #include "DCCpp_Uno.h"
@@ -24,9 +36,18 @@ Part of DCC++ BASE STATION for the Arduino
 
 extern int __heap_start, *__brkval;
 
+#if ISR_TIMING == 1
+  extern IsrTiming mainTiming, progTiming;
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 
-char SerialCommand::commandString[MAX_COMMAND_LENGTH+1];
+CommandBuffer SerialCommand::command;
+#if COMM_TYPE == 1
+  EthernetClient SerialCommand::client[MAX_CLIENTS];
+  CommandBuffer SerialCommand::clientCommand[MAX_CLIENTS];
+  byte SerialCommand::nextClient=0;
+#endif
 volatile RegisterList *SerialCommand::mRegs;
 volatile RegisterList *SerialCommand::pRegs;
 CurrentMonitor *SerialCommand::mMonitor;
@@ -37,51 +58,237 @@ void SerialCommand::init(volatile RegisterList *_mRegs, volatile RegisterList *_
   mRegs=_mRegs;
   pRegs=_pRegs;
   mMonitor=_mMonitor;
-  sprintf(commandString,"");
+  command.reset();
 } // SerialCommand:SerialCommand
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// CHARACTERS ARE READ STRAIGHT FROM THE RECEIVE BUFFER OF THE SERIAL LINE OR NETWORK CLIENT AND APPENDED TO A CommandBuffer BY INDEX,
+// RATHER THAN RE-SCANNING AND RE-WRITING THE WHOLE STRING FOR EVERY CHARACTER.  A COMPLETE COMMAND IS TERMINATED IN PLACE AND
+// PASSED TO parse() WITHOUT BEING COPIED.
+
+// WITH THE ETHERNET SHIELD, EACH CONNECTED CLIENT HAS ITS OWN CommandBuffer, SO COMMANDS ARRIVING FROM SEVERAL THROTTLES AT ONCE CANNOT
+// BE MIXED TOGETHER, AND EVERY CLIENT IS SERVICED ON EACH PASS THROUGH loop().  RESPONSES ARE SENT TO THE EthernetServer, WHICH SENDS
+// THEM TO EVERY CONNECTED CLIENT, SO ALL CLIENTS SEE EVERY CHANGE OF THROTTLE, TURNOUT, OR SENSOR STATE (<T>, <H>, <Q>, ETC.).
+
 void SerialCommand::process(){
-  char c;
     
   #if COMM_TYPE == 0
 
-    while(INTERFACE.available()>0){    // while there is data on the serial line
-     c=INTERFACE.read();
-     if(c=='<')                    // start of new command
-       sprintf(commandString,"");
-     else if(c=='>')               // end of new command
-       parse(commandString);                    
-     else if(strlen(commandString)<MAX_COMMAND_LENGTH)    // if comandString still has space, append character just read from serial line
-       sprintf(commandString,"%s%c",commandString,c);     // otherwise, character is ignored (but continue to look for '<' or '>')
+    while(COMM_DEVICE.available()>0){    // while there is data on the serial line
+      receive(&command,COMM_DEVICE.read());
     } // while
   
   #elif COMM_TYPE == 1
 
-    EthernetClient client=INTERFACE.available();
-
-    if(client){
-      while(client.connected() && client.available()){        // while there is data on the network
-      c=client.read();
-      if(c=='<')                    // start of new command
-        sprintf(commandString,"");
-      else if(c=='>')               // end of new command
-        parse(commandString);                    
-      else if(strlen(commandString)<MAX_COMMAND_LENGTH)    // if comandString still has space, append character just read from network
-        sprintf(commandString,"%s%c",commandString,c);     // otherwise, character is ignored (but continue to look for '<' or '>')
-      } // while
+    EthernetClient c=COMM_DEVICE.available();      // a client with data waiting, which may have just connected
+    int i;
+
+    if(c){
+      for(i=0;i<MAX_CLIENTS && client[i]!=c;i++);
+      if(i==MAX_CLIENTS){                          // new client --- give it a free command buffer
+        for(i=0;i<MAX_CLIENTS && client[i];i++);
+        if(i<MAX_CLIENTS){
+          client[i]=c;
+          clientCommand[i].reset();
+        }
+      }
     }
 
+    for(int n=0;n<MAX_CLIENTS;n++){                // service every client, starting with a different one each time
+      i=(nextClient+n)%MAX_CLIENTS;
+      if(!client[i])
+        continue;
+      if(!client[i].connected()){                  // client has gone --- free its command buffer
+        client[i].stop();
+        client[i]=EthernetClient();
+        continue;
+      }
+      for(int k=0;k<CLIENT_READ_MAX && client[i].available();k++)        // while there is data on the network, up to a limit so no client can hold up the others
+        receive(&clientCommand[i],client[i].read());
+    }
+    nextClient=(nextClient+1)%MAX_CLIENTS;
+
   #endif
 
 } // SerialCommand:process
+
+///////////////////////////////////////////////////////////////////////////////
+
+void SerialCommand::receive(CommandBuffer *b, char c){
+  switch(b->add(c)){
+
+    case COMMAND_TEXT:
+      parse(b->buf);
+      break;
+
+    case COMMAND_BINARY:
+      parseBinary((byte *)b->buf);
+      break;
+
+    case COMMAND_INVALID:
+      INTERFACE.print("<X>");
+      break;
+  }
+} // SerialCommand::receive
+
+///////////////////////////////////////////////////////////////////////////////
+
+void CommandBuffer::reset(){
+  len=0;
+  binary=0;
+  buf[0]='\0';
+} // CommandBuffer::reset
+
+///////////////////////////////////////////////////////////////////////////////
+
+// ADDS ONE CHARACTER TO THE COMMAND BEING ASSEMBLED.  RETURNS COMMAND_TEXT WHEN c IS '>', LEAVING THE COMPLETE COMMAND (WITHOUT < AND >)
+// IN buf, OR COMMAND_BINARY WHEN THE LAST BYTE OF A BINARY FRAME ARRIVES, LEAVING THE FRAME (FROM LENGTH THROUGH CRC) IN buf.
+// THE COMMAND IN buf STAYS VALID UNTIL THE NEXT CHARACTER IS ADDED.
+
+byte CommandBuffer::add(char c){
+  if(binary){                         // receiving a binary frame
+    buf[len++]=c;
+    if(len==1 && (c==0 || (byte)c>MAX_COMMAND_LENGTH-1)){      // invalid length --- discard frame
+      binary=0;
+      len=0;
+      return(COMMAND_INVALID);
+    }
+    if(len>1 && len==(byte)buf[0]+2){ // length, command and parameters, and CRC have all arrived
+      binary=0;
+      len=0;
+      return(COMMAND_BINARY);
+    }
+  } else if((byte)c==BINARY_START_BYTE){      // start of new binary frame
+    binary=1;
+    len=0;
+  } else if(c=='<'){                  // start of new command
+    len=0;
+  } else if(c=='>'){                  // end of new command
+    buf[len]='\0';
+    len=0;
+    return(COMMAND_TEXT);
+  } else if(len<MAX_COMMAND_LENGTH){  // if command still has space, append character
+    buf[len++]=c;                     // otherwise, character is ignored (but continue to look for '<' or '>')
+  }
+  return(COMMAND_NONE);
+} // CommandBuffer::add
+
+///////////////////////////////////////////////////////////////////////////////
+
+// CONVERTS UP TO MAX_COMMAND_PARAMS SPACE-SEPARATED INTEGERS IN s INTO p, AND RETURNS THE NUMBER CONVERTED.  CONVERSION STOPS AT THE END OF
+// THE STRING OR AT THE FIRST CHARACTER THAT DOES NOT START A NUMBER, AS WITH sscanf(), BUT WITHOUT THE SIZE AND SPEED COST OF sscanf().
+// IF hexBytes IS SET, EVERY PARAMETER AFTER THE FIRST IS READ AS HEXADECIMAL (USED FOR THE PACKET BYTES OF <M> AND <P>).
+
+int SerialCommand::parseParams(char *s, int *p, boolean hexBytes){
+  int n=0;
+  int v;
+  byte d;
+  boolean neg;
+  char *start;
+
+  while(n<MAX_COMMAND_PARAMS){
+    while(*s==' ')
+      s++;
+    neg=(*s=='-');
+    if(neg || *s=='+')
+      s++;
+    v=0;
+    start=s;
+    if(hexBytes && n>0){
+      while(true){
+        if(*s>='0' && *s<='9')
+          d=*s-'0';
+        else if((*s|0x20)>='a' && (*s|0x20)<='f')
+          d=(*s|0x20)-'a'+10;
+        else
+          break;
+        v=(v<<4)+d;
+        s++;
+      }
+    } else {
+      while(*s>='0' && *s<='9')
+        v=v*10+(*s++-'0');
+    }
+    if(s==start)                            // no digits --- end of parameters
+      break;
+    p[n++]=neg?-v:v;
+  }
+
+  return(n);
+} // SerialCommand::parseParams
+
+///////////////////////////////////////////////////////////////////////////////
+
+// CHECKS THE CRC OF A BINARY FRAME (STARTING WITH ITS LENGTH BYTE), UNPACKS ITS PARAMETERS, AND CARRIES OUT THE COMMAND.
+
+void SerialCommand::parseBinary(byte *f){
+  int p[MAX_COMMAND_PARAMS]={0};     // parameters not given in the frame read as zero, as in parse()
+  int n=0;
+  byte *end=f+f[0]+1;               // the CRC byte follows the last parameter
+  byte *b=f+2;                      // the first parameter follows the command
+  unsigned int v;
+  byte shift;
+
+  if(crc8(f,f[0]+1)!=*end){
+    INTERFACE.print("<X>");
+    return;
+  }
+
+  while(b<end){
+    if(n==MAX_COMMAND_PARAMS){      // too many parameters
+      INTERFACE.print("<X>");
+      return;
+    }
+    v=0;
+    shift=0;
+    do{
+      if(b==end || shift>14 || (shift==14 && (*b&0x7F)>3)){     // last parameter is cut short, or does not fit in 16 bits (an int on the Arduino)
+        INTERFACE.print("<X>");
+        return;
+      }
+      v|=(unsigned int)(*b&0x7F)<<shift;
+      shift+=7;
+    } while(*b++&0x80);
+    p[n++]=(v>>1)^(-(int)(v&1));    // undo zig-zag encoding
+  }
+
+  execute(f[1],p,n);
+} // SerialCommand::parseBinary
+
+///////////////////////////////////////////////////////////////////////////////
+
+byte SerialCommand::crc8(byte *b, int n){
+  byte crc=0;
+
+  while(n-->0){
+    crc^=*b++;
+    for(int i=0;i<8;i++)
+      crc=(crc&0x80)?(crc<<1)^0x07:(crc<<1);
+  }
+  return(crc);
+} // SerialCommand::crc8
    
 ///////////////////////////////////////////////////////////////////////////////
 
+// THE PARAMETERS OF EVERY COMMAND ARE CONVERTED ONCE, HERE, AND PASSED TO THE HANDLERS AS AN ARRAY OF INTEGERS, SO NO HANDLER NEEDS sscanf().
+// PARAMETERS NOT GIVEN IN THE COMMAND READ AS ZERO, SINCE SOME HANDLERS LOOK AT p[1] OR p[2] BEFORE CHECKING HOW MANY WERE GIVEN.
+
 void SerialCommand::parse(char *com){
+  int p[MAX_COMMAND_PARAMS]={0};
+  int n;
+
+  n=parseParams(com+1,p,com[0]=='M' || com[0]=='P');
+  execute(com[0],p,n);
+} // SerialCommand::parse
+
+///////////////////////////////////////////////////////////////////////////////
+
+// CARRIES OUT COMMAND c WITH n PARAMETERS IN p, WHETHER IT ARRIVED AS TEXT OR AS A BINARY FRAME.
+
+void SerialCommand::execute(char c, int *p, int n){
   
-  switch(com[0]){
+  switch(c){
 
 /***** SET ENGINE THROTTLES USING 128-STEP SPEED CONTROL ****/    
 
@@ -94,10 +301,41 @@ void SerialCommand::parse(char *com){
  *    SPEED: throttle speed from 0-126, or -1 for emergency stop (resets SPEED to 0)
  *    DIRECTION: 1=forward, 0=reverse.  Setting direction when speed=0 or speed=-1 only effects directionality of cab lighting for a stopped train
  *    
+ *    if CAB was held by a different register, that register is released (set to idle packets), so a cab is never driven from two registers
+ *    
  *    returns: <T REGISTER SPEED DIRECTION>
  *    
+ *    <t CAB SPEED DIRECTION>
+ *    
+ *    sets the throttle for a given cab, letting the Base Station select the register.  The register already holding CAB is re-used;
+ *    otherwise a register never used, then one holding only idle packets, is used; otherwise the register of the least-recently-commanded
+ *    stopped cab is taken over (that cab is no longer refreshed until it is commanded again).  Registers written with <M> are never selected.
+ *    Clients using this form should not also select registers themselves.
+ *    
+ *    returns: <T REGISTER SPEED DIRECTION>, or <X> if every register holds a moving cab
+ *    
+ */
+      mRegs->setThrottle(p,n);
+      break;
+
+/***** EMERGENCY STOP ****/    
+
+    case '!':       // <!>
+/*
+ *    sends emergency stop packets to all engine decoders on the main operations track at the next packet boundary, ahead of any
+ *    other pending packets, and sets every throttle register to emergency stop (SPEED=0).  A one-time packet already being repeated
+ *    (such as a <w> or <b> CV write) is finished after the emergency stop packets, not discarded
+ *    
+ *    <! CAB>
+ *    
+ *    as above, but only for the given cab
+ *    
+ *    CAB:  the short (1-127) or long (128-10293) address of the engine decoder
+ *    
+ *    returns: <O>, or <X> if CAB is invalid
+ *    
  */
-      mRegs->setThrottle(com+1);
+      mRegs->emergencyStop(p,n);
       break;
 
 /***** OPERATE ENGINE DECODER FUNCTIONS F0-F28 ****/    
@@ -105,7 +343,8 @@ void SerialCommand::parse(char *com){
     case 'f':       // <f CAB BYTE1 [BYTE2]>
 /*
  *    turns on and off engine decoder functions F0-F28 (F0 is sometimes called FL)  
- *    NOTE: setting requests transmitted directly to mobile engine decoder --- current state of engine functions is not stored by this program
+ *    NOTE: setting requests are transmitted directly to mobile engine decoder.  If CAB currently holds a throttle register, the last setting
+ *    of each function group is also stored and periodically re-sent, at a lower rate than throttle settings, until the register is re-assigned
  *    
  *    CAB:  the short (1-127) or long (128-10293) address of the engine decoder
  *    
@@ -137,7 +376,7 @@ void SerialCommand::parse(char *com){
  *    returns: NONE
  * 
  */
-      mRegs->setFunction(com+1);
+      mRegs->setFunction(p,n);
       break;
       
 /***** OPERATE STATIONARY ACCESSORY DECODERS  ****/    
@@ -162,7 +401,7 @@ void SerialCommand::parse(char *com){
  *    
  *    returns: NONE
  */
-      mRegs->setAccessory(com+1);
+      mRegs->setAccessory(p,n);
       break;
 
 /***** CREATE/EDIT/REMOVE/SHOW & OPERATE A TURN-OUT  ****/    
@@ -179,7 +418,7 @@ void SerialCommand::parse(char *com){
  *   *** SEE ACCESSORIES.CPP FOR COMPLETE INFO ON THE DIFFERENT VARIATIONS OF THE "T" COMMAND
  *   USED TO CREATE/EDIT/REMOVE/SHOW TURNOUT DEFINITIONS
  */
-      Turnout::parse(com+1);
+      Turnout::parse(p,n);
       break;
 
 /***** CREATE/EDIT/REMOVE/SHOW & OPERATE AN OUTPUT PIN  ****/    
@@ -196,7 +435,7 @@ void SerialCommand::parse(char *com){
  *   *** SEE OUTPUTS.CPP FOR COMPLETE INFO ON THE DIFFERENT VARIATIONS OF THE "O" COMMAND
  *   USED TO CREATE/EDIT/REMOVE/SHOW TURNOUT DEFINITIONS
  */
-      Output::parse(com+1);
+      Output::parse(p,n);
       break;
       
 /***** CREATE/EDIT/REMOVE/SHOW A SENSOR  ****/    
@@ -206,7 +445,7 @@ void SerialCommand::parse(char *com){
  *   *** SEE SENSOR.CPP FOR COMPLETE INFO ON THE DIFFERENT VARIATIONS OF THE "S" COMMAND
  *   USED TO CREATE/EDIT/REMOVE/SHOW SENSOR DEFINITIONS
  */
-      Sensor::parse(com+1);
+      Sensor::parse(p,n);
       break;
 
 /***** SHOW STATUS OF ALL SENSORS ****/
@@ -218,6 +457,24 @@ void SerialCommand::parse(char *com){
       Sensor::status();
       break;
 
+/***** CREATE/REMOVE/SHOW ADVANCED CONSISTS  ****/    
+
+    case 'C':      // <C CONSIST CAB DIRECTION>
+/*
+ *   <C CONSIST CAB DIRECTION>:   adds an engine to an advanced consist by writing CV19 of its decoder on the main operations track.
+ *                                any throttle register holding CAB is set to stop and released for re-use
+ *   <C CAB>:                     removes an engine from its advanced consist by clearing CV19
+ *   <C>:                         lists all consist members set since power-up
+ *   
+ *   CONSIST: the short address (1-127) of the consist.  Use <t CONSIST SPEED DIRECTION> to drive all members with a single register
+ *   CAB:  the short (1-127) or long (128-10293) address of the member engine decoder
+ *   DIRECTION: 1=member runs in the consist's direction, 0=member runs reversed
+ *   
+ *   returns: <O> if successful and <X> if unsuccessful (e.g. too many members), or for <C>, <U CONSIST CAB DIRECTION> for each member or <X> if there are none
+ */
+      mRegs->setConsist(p,n);
+      break;
+
 /***** WRITE CONFIGURATION VARIABLE BYTE TO ENGINE DECODER ON MAIN OPERATIONS TRACK  ****/    
 
     case 'w':      // <w CAB CV VALUE>
@@ -230,7 +487,7 @@ void SerialCommand::parse(char *com){
  *    
  *    returns: NONE
 */    
-      mRegs->writeCVByteMain(com+1);
+      mRegs->writeCVByteMain(p,n);
       break;      
 
 /***** WRITE CONFIGURATION VARIABLE BIT TO ENGINE DECODER ON MAIN OPERATIONS TRACK  ****/    
@@ -246,7 +503,7 @@ void SerialCommand::parse(char *com){
  *    
  *    returns: NONE
 */        
-      mRegs->writeCVBitMain(com+1);
+      mRegs->writeCVBitMain(p,n);
       break;      
 
 /***** WRITE CONFIGURATION VARIABLE BYTE TO ENGINE DECODER ON PROGRAMMING TRACK  ****/    
@@ -262,8 +519,10 @@ void SerialCommand::parse(char *com){
  *    
  *    returns: <r CALLBACKNUM|CALLBACKSUB|CV Value)
  *    where VALUE is a number from 0-255 as read from the requested CV, or -1 if verificaiton read fails
+ *    NOTE: the response is sent once the operation completes, while other commands continue to be processed.  VALUE is -1 immediately if
+ *    another read or write is still in progress on the programming track
 */    
-      pRegs->writeCVByte(com+1);
+      pRegs->writeCVByte(p,n);
       break;      
 
 /***** WRITE CONFIGURATION VARIABLE BIT TO ENGINE DECODER ON PROGRAMMING TRACK  ****/    
@@ -280,8 +539,10 @@ void SerialCommand::parse(char *com){
  *    
  *    returns: <r CALLBACKNUM|CALLBACKSUB|CV BIT VALUE)
  *    where VALUE is a number from 0-1 as read from the requested CV bit, or -1 if verificaiton read fails
+ *    NOTE: the response is sent once the operation completes, while other commands continue to be processed.  VALUE is -1 immediately if
+ *    another read or write is still in progress on the programming track
 */    
-      pRegs->writeCVBit(com+1);
+      pRegs->writeCVBit(p,n);
       break;      
 
 /***** READ CONFIGURATION VARIABLE BYTE FROM ENGINE DECODER ON PROGRAMMING TRACK  ****/    
@@ -296,8 +557,43 @@ void SerialCommand::parse(char *com){
  *    
  *    returns: <r CALLBACKNUM|CALLBACKSUB|CV VALUE)
  *    where VALUE is a number from 0-255 as read from the requested CV, or -1 if read could not be verified
+ *    NOTE: the response is sent once the operation completes, while other commands continue to be processed.  VALUE is -1 immediately if
+ *    another read or write is still in progress on the programming track
+ *    
+ *    <R FIRST LAST CALLBACKNUM CALLBACKSUB>
+ *    
+ *    reads each Configuration Variable from FIRST through LAST (1-1024), keeping the decoder in service mode for the whole batch
+ *    
+ *    NOTE: the Base Station remembers recently read and written CVs.  When such a CV is read again, the remembered value is first checked with
+ *    a single verify, and the CV is only read bit by bit if that fails
+ *    
+ *    returns: <r CALLBACKNUM|CALLBACKSUB|CV VALUE) for each CV as soon as it has been read
+ *    
+ *    <R>
+ *    
+ *    cancels a read (or the rest of a batch read) in progress.  No response is sent for the CV being read when cancelled
+ *    
+ *    returns: <O> if a read was cancelled, or <X> if no read was in progress
+*/    
+      pRegs->readCV(p,n);
+      break;
+
+/***** CALIBRATE ACKNOWLEDGEMENT THRESHOLD ON PROGRAMMING TRACK  ****/    
+
+    case 'A':     // <A>
+/*    
+ *    <A 1>:  measures the idle current and noise floor of the programming track, and sets the threshold used to detect decoder acknowledgements
+ *            just above the noise floor, but not below the default.  Place the engine on the programming track, with power on, before calibrating.
+ *            Use <E> to save the calibration
+ *    <A 2>:  the same, but allows a threshold below the default, for decoders with weak acknowledgements on a quiet track
+ *    <A 0>:  restores the default threshold
+ *    <A>:    shows the calibration in use
+ *    
+ *    returns: <k BASE NOISE THRESHOLD> (for <A 1> and <A 2>, once calibration completes), or <X> if the programming track is busy, or if
+ *    calibration finds no decoder drawing current on the programming track (in which case the threshold in use is kept)
+ *    where BASE is the idle current, NOISE is the largest smoothed deviation from BASE, and THRESHOLD is the acknowledgement threshold in use
 */    
-      pRegs->readCV(com+1);
+      pRegs->calibrateAck(p,n);
       break;
 
 /***** TURN ON POWER FROM MOTOR SHIELD TO TRACKS  ****/    
@@ -307,7 +603,12 @@ void SerialCommand::parse(char *com){
  *    enables power from the motor shield to the main operations and programming tracks
  *    
  *    returns: <p1>
+ *    
+ *    NOTE: after an overload, each track is shut down on its own and power is restored automatically, with a growing wait
+ *    each time, a limited number of times (see CurrentMonitor.cpp), reporting <p4 TRACK ATTEMPT>.  Once <p5 TRACK> is returned,
+ *    power stays off until <1> is sent again
  */    
+     CurrentMonitor::powerOn=1;
      digitalWrite(SIGNAL_ENABLE_PIN_PROG,HIGH);
      digitalWrite(SIGNAL_ENABLE_PIN_MAIN,HIGH);
      INTERFACE.print("<p1>");
@@ -321,6 +622,7 @@ void SerialCommand::parse(char *com){
  *    
  *    returns: <p0>
  */
+     CurrentMonitor::powerOn=0;
      digitalWrite(SIGNAL_ENABLE_PIN_PROG,LOW);
      digitalWrite(SIGNAL_ENABLE_PIN_MAIN,LOW);
      INTERFACE.print("<p0>");
@@ -336,7 +638,7 @@ void SerialCommand::parse(char *com){
  *    where CURRENT = 0-1024, based on exponentially-smoothed weighting scheme
  */
       INTERFACE.print("<a");
-      INTERFACE.print(int(mMonitor->current));
+      INTERFACE.print(mMonitor->current.get());
       INTERFACE.print(">");
       break;
 
@@ -349,7 +651,7 @@ void SerialCommand::parse(char *com){
  *    
  *    returns: series of status messages that can be read by an interface to determine status of DCC++ Base Station and important settings
  */
-      if(digitalRead(SIGNAL_ENABLE_PIN_PROG)==LOW)      // could check either PROG or MAIN
+      if(digitalRead(SIGNAL_ENABLE_PIN_MAIN)==LOW)      // Programming Track may be shut down on its own after an overload, so report Main Track
         INTERFACE.print("<p0>");
       else
         INTERFACE.print("<p1>");
@@ -400,6 +702,7 @@ void SerialCommand::parse(char *com){
     case 'E':     // <E>
 /*
  *    stores settings for turnouts and sensors EEPROM
+ *    (also stores outputs, and the programming track acknowledgement calibration set with <A 1>)
  *    
  *    returns: <e nTurnouts nSensors>
 */
@@ -491,9 +794,12 @@ void SerialCommand::parse(char *com){
  *    BYTE4:  optional fourth hexidecimal byte in the packet
  *    BYTE5:  optional fifth hexidecimal byte in the packet
  *   
+ *    a stored packet replaces any cab held by REGISTER, and REGISTER is not selected by <t CAB SPEED DIRECTION> until set again with <t REGISTER ...>
+ *    (<v> reports its CAB as -1)
+ *   
  *    returns: NONE   
  */
-      mRegs->writeTextPacket(com+1);
+      mRegs->writeTextPacket(p,n);
       break;
 
 /***** WRITE A DCC PACKET TO ONE OF THE REGSITERS DRIVING THE MAIN OPERATIONS TRACK  ****/    
@@ -512,7 +818,7 @@ void SerialCommand::parse(char *com){
  *   
  *    returns: NONE   
  */
-      pRegs->writeTextPacket(com+1);
+      pRegs->writeTextPacket(p,n);
       break;
             
 /***** ATTEMPTS TO DETERMINE HOW MUCH FREE SRAM IS AVAILABLE IN ARDUINO  ****/        
@@ -532,11 +838,58 @@ void SerialCommand::parse(char *com){
       INTERFACE.print(">");
       break;
 
+/***** REPORTS PACKET AND REFRESH TELEMETRY  ****/        
+
+    case 'V':     // <V>
+/*
+ *    reports packet telemetry for the main operations track and the programming track, and output buffer use, gathered since the last <V> command, then starts over
+ *    
+ *    returns: <V TRACK PACKETS ONESHOTS> for each track (MAIN then PROG), followed by <v TRACK REGISTER CAB LAST MAX> for each loaded register on that track
+ *             then <V OUT DEPTH DROPPED BLOCKED> for the output buffer
+ *    
+ *    where
+ *    
+ *    PACKETS: the number of packets sent to the track
+ *    ONESHOTS: the number of those packets that were one-time packets (including their repeats) sent ahead of the refresh cycle from register 0
+ *    REGISTER: the register number
+ *    CAB: the cab currently held by the register, or 0 if none
+ *    LAST: the number of packets sent to the track between the last two transmissions of this register
+ *    MAX: the largest such interval
+ *    DEPTH: the most response characters waiting to be sent at any one time
+ *    DROPPED: the number of responses discarded because the output buffer was full (only when OUTPUT_POLICY is OUTPUT_POLICY_DROP)
+ *    BLOCKED: the number of times a response had to wait for room in the output buffer (only when OUTPUT_POLICY is OUTPUT_POLICY_BLOCK)
+ *    
+ *    Multiply intervals by the average packet time (roughly 6 to 10 milliseconds, depending on packet length and preamble) to convert them to time.
+ */
+      mRegs->showTelemetry("MAIN");
+      pRegs->showTelemetry("PROG");
+      outputBuffer.show();
+      break;
+
+/***** REPORTS TIMING OF THE DCC SIGNAL INTERRUPTS  ****/        
+
+    case 'I':     // <I>
+/*
+ *    reports timing statistics gathered for the Main Track and Programming Track interrupt routines since the last <I> command, then starts over
+ *    ONLY AVAILABLE WHEN ISR_TIMING IS SET IN DCCpp_Uno.h.  FOR DIAGNOSTIC AND TESTING USE ONLY
+ *    
+ *    returns: <I MAIN COUNT MIN AVG MAX LATENCY LATE H0 ... H7><I PROG COUNT MIN AVG MAX LATENCY LATE H0 ... H7>, or <X> if ISR_TIMING is not set
+ *    *** SEE DCCpp_Uno.h FOR A DESCRIPTION OF EACH FIELD
+ */
+      #if ISR_TIMING == 1
+        mainTiming.show("MAIN");
+        progTiming.show("PROG");
+      #else
+        INTERFACE.print("<X>");
+      #endif
+      break;
+
 /***** LISTS BIT CONTENTS OF ALL INTERNAL DCC PACKET REGISTERS  ****/        
 
     case 'L':     // <L>
 /*
- *    lists the packet contents of the main operations track registers and the programming track registers
+ *    lists the packet contents of the main operations track registers and the programming track registers,
+ *    followed by the current depth, maximum depth, and number of times loadPacket() found it full, for the update queue of each
  *    FOR DIAGNOSTIC AND TESTING USE ONLY
  */
       INTERFACE.println("");
@@ -560,11 +913,19 @@ void SerialCommand::parse(char *com){
         }
         INTERFACE.println("");
       }
+      INTERFACE.print("MQ:\t");
+      INTERFACE.print(mRegs->queueDepth()); INTERFACE.print("\t");
+      INTERFACE.print(mRegs->queueMaxDepth); INTERFACE.print("\t");
+      INTERFACE.println(mRegs->queueFullCount);
+      INTERFACE.print("PQ:\t");
+      INTERFACE.print(pRegs->queueDepth()); INTERFACE.print("\t");
+      INTERFACE.print(pRegs->queueMaxDepth); INTERFACE.print("\t");
+      INTERFACE.println(pRegs->queueFullCount);
       INTERFACE.println("");
       break;
 
   } // switch
-}; // SerialCommand::parse
+}; // SerialCommand::execute
 
 ///////////////////////////////////////////////////////////////////////////////
 
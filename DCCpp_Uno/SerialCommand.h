@@ -10,17 +10,54 @@ Part of DCC++ BASE STATION for the Arduino
 #ifndef SerialCommand_h
 #define SerialCommand_h
 
+#include "DCCpp_Uno.h"
 #include "PacketRegister.h"
 #include "CurrentMonitor.h"
+#include "Comm.h"
 
 #define  MAX_COMMAND_LENGTH         30
+#define  MAX_COMMAND_PARAMS          6      // largest number of parameters taken by any command (<M> and <P> take a register and up to 5 bytes)
+
+// Define the start byte and results used for the optional binary command protocol (see SerialCommand.cpp)
+
+#define  BINARY_START_BYTE        0xFE      // never appears in a text command, so marks the start of a binary frame
+
+#define  COMMAND_NONE                0      // command not yet complete
+#define  COMMAND_TEXT                1      // complete text command in buf
+#define  COMMAND_BINARY              2      // complete binary frame in buf
+#define  COMMAND_INVALID             3      // binary frame with an invalid length was discarded
+
+// Define the number of network clients that can send commands at the same time, and how much is read from each on every pass through loop()
+
+#if COMM_TYPE == 1
+  #define  MAX_CLIENTS     MAX_SOCK_NUM      // one command buffer for each socket of the Ethernet Shield
+  #define  CLIENT_READ_MAX           64      // largest number of characters read from any one client before moving on to the next
+#endif
+
+struct CommandBuffer{
+  char buf[MAX_COMMAND_LENGTH+1];
+  byte len;                         // number of characters stored so far
+  byte binary;                      // set while receiving a binary frame
+  void reset();
+  byte add(char);
+}; // CommandBuffer
 
 struct SerialCommand{
-  static char commandString[MAX_COMMAND_LENGTH+1];
+  static CommandBuffer command;
+#if COMM_TYPE == 1
+  static EthernetClient client[MAX_CLIENTS];
+  static CommandBuffer clientCommand[MAX_CLIENTS];
+  static byte nextClient;
+#endif
   static volatile RegisterList *mRegs, *pRegs;
   static CurrentMonitor *mMonitor;
   static void init(volatile RegisterList *, volatile RegisterList *, CurrentMonitor *);
+  static void receive(CommandBuffer *, char);
   static void parse(char *);
+  static int parseParams(char *, int *, boolean);
+  static void parseBinary(byte *);
+  static byte crc8(byte *, int);
+  static void execute(char, int *, int);
   static void process();
 }; // SerialCommand
   
@@ -0,0 +1,540 @@
+/**********************************************************************
+
+Sim.cpp
+COPYRIGHT (c) 2013-2016 Gregg E. Berman
+
+Part of DCC++ BASE STATION for the Arduino
+
+**********************************************************************/
+/**********************************************************************
+
+The simulator runs the unmodified sketch on a Linux host.  DCCpp_Uno.ino and every module are compiled
+against the stand-in Arduino.h and EEPROM.h headers in tools/sim/stub, and Sim then plays the part of
+the Arduino hardware on a simulated clock, in microseconds:
+
+  * the Main Track and Programming Track timer interrupts are called once per DCC bit.  The length of
+    each bit is taken from the OCRnA value the interrupt code leaves behind, exactly as the timer would,
+    and the resulting waveform is decoded back into NMRA packets, with checksums checked;
+
+  * the ADC interrupt is called every SIM_ADC_MICROS, with ADC holding the current of whichever track
+    ADMUX selects.  Each track draws load[] counts while its enable pin is HIGH, plus noise, plus ackLoad
+    while the decoder on the Programming Track is acknowledging;
+
+  * the decoder on the Programming Track answers service-mode verify and write packets against cv[],
+    acting on the second of two identical packets, as decoders do;
+
+  * loop() is called over and over, each pass taking loopMicros of simulated time, during which the
+    interrupts that fall due are run.  stall() runs only the interrupts, as if one pass of loop() were slow.
+    Characters written to Serial take SIM_SERIAL_MICROS each to go out, and a write to a full transmit
+    buffer holds up loop() until there is room, as on the Arduino.
+
+millis() follows the simulated clock.  On the Uno, millis() counts overflows of TIMER-0, which the sketch
+re-purposes for the Programming Track, so it advances 1.024 ms per Programming Track bit as on the board.
+
+A few paths in the sketch (loadPacket() with a full update queue, and emergencyStop()) spin until the interrupt
+code makes progress.  If one pass of loop() runs for more than SIM_RESCUE_MILLIS of wall-clock time while the
+sketch is in such a wait, a second thread runs the interrupts alongside it, one at a time and never inside
+noInterrupts(), until the wait is over.  Since the interrupts stop as soon as the wait is over, the results
+stay the same from run to run.
+
+**********************************************************************/
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include "Sim.h"
+#include "EEPROM.h"
+#include "DCCpp_Uno.h"
+#include "Config.h"
+#include "PacketRegister.h"
+
+extern volatile RegisterList mainRegs;
+extern volatile RegisterList progRegs;
+
+void setup();
+void loop();
+void TIMER1_COMPB_vect();
+#ifdef ARDUINO_AVR_UNO
+  void TIMER0_COMPB_vect();
+#else
+  void TIMER3_COMPB_vect();
+#endif
+void ADC_vect();
+
+volatile uint16_t OCR1A, OCR1B, OCR3A, OCR3B, TCNT1, TCNT3, ADC;
+volatile uint8_t OCR0A, OCR0B, TCNT0;
+volatile uint8_t TCCR0A, TCCR0B, TCCR1A, TCCR1B, TCCR3A, TCCR3B, TIMSK0, TIMSK1, TIMSK3, CLKPR;
+volatile uint8_t ADCSRA, ADCSRB, ADMUX;
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+int __heap_start, *__brkval;                     // used by the free memory report of <F>
+
+unsigned long long Sim::now=0;
+unsigned int Sim::loopMicros=100;
+unsigned long Sim::loops=0;
+unsigned long long Sim::isrTime[3];
+unsigned long Sim::isrCount[3];
+int Sim::load[2]={20,20};
+int Sim::noise=2;
+int Sim::ackLoad=60;
+unsigned int Sim::ackMicros=6000;
+byte Sim::ackRepeat=0;
+byte Sim::cv[1024];
+unsigned long Sim::ackCount=0;
+unsigned long long Sim::ackStart=0, Sim::ackEnd=0;
+std::vector<SimPacket> Sim::packets[2];
+SimDecoder Sim::decoder[2];
+byte Sim::pins[64];
+std::string Sim::out;
+
+static unsigned long long eventTime[3];          // next Main Track bit, Programming Track bit, and ADC conversion
+static unsigned long progBits;                   // TIMER-0 overflows on the Uno
+static unsigned long long serialFree;            // time at which the serial transmit buffer will be empty
+static std::string serialIn;
+static size_t serialInPos;
+static unsigned long randomState=12345;
+static byte lastProg[8], lastProgN, sameProg;
+
+static std::recursive_mutex hardware;            // held while an interrupt runs, and by noInterrupts()
+static std::atomic<int> rescueState(0);          // set while loop() is running
+static std::atomic<unsigned long> loopSequence(0);
+static byte interruptsOff;
+
+///////////////////////////////////////////////////////////////////////////////
+
+static unsigned long long hostNanos(){
+  return(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// FEEDS ONE BIT OF A TRACK'S WAVEFORM TO ITS DECODER:  A PREAMBLE OF AT LEAST 10 ONES, A ZERO START BIT, AND THEN BYTES SEPARATED BY
+// ZERO BITS UNTIL A ONE END BIT
+
+void SimDecoder::receive(int track, int v){
+  if(!inPacket){
+    if(v)
+      ones++;
+    else{
+      if(ones>=10){
+        inPacket=1;
+        n=0;
+        nBits=0;
+        b[0]=0;
+      }
+      ones=0;
+    }
+    return;
+  }
+
+  if(nBits<8){
+    b[n]=(b[n]<<1)|v;
+    if(++nBits==8)
+      n++;
+    return;
+  }
+
+  if(v==0 && n<sizeof(b)){                      // byte separator
+    nBits=0;
+    b[n]=0;
+    return;
+  }
+
+  inPacket=0;
+  ones=v;                                        // the end bit can also be the first bit of the next preamble
+  byte x=0;
+  for(int i=0;i<n;i++)
+    x^=b[i];
+  if(v==0 || x!=0 || n<2 || n>6)
+    errors++;
+  else
+    Sim::packet(track,b,n);
+} // SimDecoder::receive
+
+///////////////////////////////////////////////////////////////////////////////
+
+// RECORDS EACH DECODED PACKET, AND HAS THE DECODER ON THE PROGRAMMING TRACK ACT ON SERVICE-MODE INSTRUCTIONS (DIRECT MODE, LONG FORM)
+
+void Sim::packet(int track, const byte *b, int n){
+  SimPacket p;
+
+  p.time=now;
+  p.n=n;
+  memcpy(p.b,b,n);
+  packets[track].push_back(p);
+
+  if(track!=SIM_PROG)
+    return;
+
+  if(n==lastProgN && memcmp(b,lastProg,n)==0)
+    sameProg++;
+  else
+    sameProg=1;
+  memcpy(lastProg,b,n);
+  lastProgN=n;
+
+  if(n!=4 || (b[0]&0xF0)!=0x70 || sameProg<2 || (sameProg>2 && !ackRepeat) || !powered(SIM_PROG))
+    return;
+
+  int c=((b[0]&0x03)<<8)+b[1];
+  int ack=0;
+
+  switch(b[0]&0x0C){
+    case 0x04:                                   // verify byte
+      ack=(cv[c]==b[2]);
+      break;
+    case 0x0C:                                   // write byte
+      cv[c]=b[2];
+      ack=1;
+      break;
+    case 0x08:                                   // bit manipulation
+      if(b[2]&0x10){
+        bitWrite(cv[c],b[2]&0x07,bitRead(b[2],3));
+        ack=1;
+      } else
+        ack=(bitRead(cv[c],b[2]&0x07)==bitRead(b[2],3));
+      break;
+  }
+
+  if(ack && now>=ackEnd){                        // a decoder that is already acknowledging does not start a new pulse
+    ackStart=now;
+    ackEnd=now+ackMicros;
+    ackCount++;
+  }
+} // Sim::packet
+
+///////////////////////////////////////////////////////////////////////////////
+
+boolean Sim::powered(int track){
+  return(pins[track==SIM_MAIN?SIGNAL_ENABLE_PIN_MAIN:SIGNAL_ENABLE_PIN_PROG]==HIGH);
+} // Sim::powered
+
+///////////////////////////////////////////////////////////////////////////////
+
+// RUNS THE NEXT INTERRUPT DUE, PROVIDED IT IS DUE NO LATER THAN limit
+
+static boolean runInterrupt(unsigned long long limit){
+  int e=0;
+  unsigned long long t0;
+  unsigned int d;
+
+  for(int i=1;i<3;i++)
+    if(eventTime[i]<eventTime[e])
+      e=i;
+  if(eventTime[e]>limit)
+    return(false);
+
+  std::lock_guard<std::recursive_mutex> lock(hardware);
+  Sim::now=eventTime[e];
+
+  switch(e){
+
+    case SIM_MAIN:                               // timer interrupt at the middle of each bit sets up the following bit
+      t0=hostNanos();
+      TIMER1_COMPB_vect();
+      Sim::isrTime[e]+=hostNanos()-t0;
+      d=(OCR1A+1)/16;
+      Sim::decoder[SIM_MAIN].receive(SIM_MAIN,d<MAIN_ONE_BIT_HALF_PERIOD+MAIN_ZERO_BIT_HALF_PERIOD);
+      break;
+
+    case SIM_PROG:
+      t0=hostNanos();
+#ifdef ARDUINO_AVR_UNO
+      TIMER0_COMPB_vect();
+      Sim::isrTime[e]+=hostNanos()-t0;
+      d=(OCR0A+1)*4;
+#else
+      TIMER3_COMPB_vect();
+      Sim::isrTime[e]+=hostNanos()-t0;
+      d=(OCR3A+1)/16;
+#endif
+      progBits++;
+      Sim::decoder[SIM_PROG].receive(SIM_PROG,d<PROG_ONE_BIT_HALF_PERIOD+PROG_ZERO_BIT_HALF_PERIOD);
+      break;
+
+    default:{                                    // ADC conversion complete
+      int pin=(ADMUX&0x07)+A0;
+#ifdef MUX5
+      if(bitRead(ADCSRB,MUX5))
+        pin+=8;
+#endif
+      int track=(pin==CURRENT_MONITOR_PIN_MAIN)?SIM_MAIN:SIM_PROG;
+      int v=0;
+      if(Sim::powered(track)){
+        randomState=randomState*1103515245+12345;
+        v=Sim::load[track]+(int)((randomState>>16)%(2*Sim::noise+1))-Sim::noise;
+        if(track==SIM_PROG && Sim::now>=Sim::ackStart && Sim::now<Sim::ackEnd)
+          v+=Sim::ackLoad;
+      }
+      ADC=constrain(v,0,1023);
+      t0=hostNanos();
+      ADC_vect();
+      Sim::isrTime[e]+=hostNanos()-t0;
+      d=SIM_ADC_MICROS;
+    }
+  }
+
+  Sim::isrCount[e]++;
+  eventTime[e]+=d;
+  return(true);
+} // runInterrupt
+
+///////////////////////////////////////////////////////////////////////////////
+
+// RUNS THE INTERRUPTS ALONGSIDE A PASS OF loop() THAT HAS SPUN FOR SIM_RESCUE_MILLIS WAITING ON ONE OF THEM, FOR JUST AS LONG AS THE
+// CONDITION IT WAITS ON HOLDS --- SO THE SIMULATED TIME THAT PASSES DOES NOT DEPEND ON HOW FAST THE HOST RUNS
+
+static boolean queueFull(volatile RegisterList *r){
+  return(r->queueDepth()==r->queueSize);
+}
+
+static boolean spinning(){
+  if(queueFull(&mainRegs) || queueFull(&progRegs))             // loadPacket() waits for room in the update queue
+    return(true);
+  if(mainRegs.nStop==255)                                        // emergencyStop() waits for the interrupt code to switch to stopReg
+    return(mainRegs.currentReg!=mainRegs.stopReg);
+  return(mainRegs.nStop>0 || mainRegs.currentReg==mainRegs.stopReg);      // emergencyStop() waits for an earlier emergency stop to finish
+}
+
+static void rescue(){
+  unsigned long seq=0;
+  unsigned long long since=0;
+
+  while(true){
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    if(rescueState!=1 || loopSequence!=seq){
+      seq=loopSequence;
+      since=hostNanos();
+      continue;
+    }
+    if(hostNanos()-since<SIM_RESCUE_MILLIS*1000000ULL)
+      continue;
+    while(loopSequence==seq && spinning())
+      runInterrupt(~0ULL);
+    since=hostNanos();
+  }
+} // rescue
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Sim::begin(){
+  static std::thread *rescuer=NULL;
+
+  memset(EEPROM.data,0xFF,sizeof(EEPROM.data));
+  memset(pins,0,sizeof(pins));
+  setup();
+  eventTime[SIM_MAIN]=now+MAIN_ONE_BIT_HALF_PERIOD;
+  eventTime[SIM_PROG]=now+PROG_ONE_BIT_HALF_PERIOD+1;
+  eventTime[2]=now+SIM_ADC_MICROS;
+  if(rescuer==NULL){
+    rescuer=new std::thread(rescue);
+    rescuer->detach();
+  }
+} // Sim::begin
+
+///////////////////////////////////////////////////////////////////////////////
+
+// ADVANCES THE CLOCK TO t, RUNNING THE INTERRUPTS THAT FALL DUE
+
+void Sim::next(unsigned long long t){
+  while(runInterrupt(t));
+  if(now<t)
+    now=t;
+} // Sim::next
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Sim::run(unsigned long us){
+  unsigned long long end=now+us;
+
+  while(now<end){
+    unsigned long long start=now;
+    rescueState=1;
+    loop();
+    loopSequence++;
+    rescueState=0;
+    loops++;
+    next(max(now,start)+loopMicros);
+    if(serialFree>now+SIM_SERIAL_TX_SIZE*SIM_SERIAL_MICROS)      // loop() had to wait for room in the serial transmit buffer
+      next(serialFree-SIM_SERIAL_TX_SIZE*SIM_SERIAL_MICROS);
+  }
+} // Sim::run
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Sim::stall(unsigned long us){
+  next(now+us);
+} // Sim::stall
+
+///////////////////////////////////////////////////////////////////////////////
+
+// RUNS UNTIL text APPEARS IN THE SERIAL OUTPUT, OR maxUs HAS PASSED
+
+boolean Sim::runUntil(const char *text, unsigned long maxUs){
+  unsigned long long end=now+maxUs;
+
+  while(out.find(text)==std::string::npos){
+    if(now>=end)
+      return(false);
+    run(loopMicros);
+  }
+  return(true);
+} // Sim::runUntil
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Sim::send(const char *s){
+  serialIn+=s;
+} // Sim::send
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Sim::send(const byte *b, int n){
+  serialIn.append((const char *)b,n);
+} // Sim::send
+
+///////////////////////////////////////////////////////////////////////////////
+
+std::string Sim::take(){
+  std::string s=out;
+  out.clear();
+  return(s);
+} // Sim::take
+
+///////////////////////////////////////////////////////////////////////////////
+// ARDUINO CORE
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned long millis(){
+#ifdef ARDUINO_AVR_UNO
+  return(progBits*1024/1000);
+#else
+  return(Sim::now/1000);
+#endif
+}
+
+unsigned long micros(){
+#ifdef ARDUINO_AVR_UNO
+  return(progBits*1024);
+#else
+  return(Sim::now);
+#endif
+}
+
+void delay(unsigned long ms){
+  Sim::next(Sim::now+ms*1000);
+}
+
+void delayMicroseconds(unsigned int us){
+  Sim::next(Sim::now+us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode){
+  if(mode==INPUT_PULLUP)
+    Sim::pins[pin]=HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t v){
+  Sim::pins[pin]=v;
+}
+
+int digitalRead(uint8_t pin){
+  return(Sim::pins[pin]);
+}
+
+int analogRead(uint8_t){
+  return(0);
+}
+
+void noInterrupts(){
+  if(!interruptsOff){
+    hardware.lock();
+    interruptsOff=1;
+  }
+}
+
+void interrupts(){
+  if(interruptsOff){
+    interruptsOff=0;
+    hardware.unlock();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+size_t Print::write(const uint8_t *b, size_t n){
+  size_t r=0;
+  while(n--)
+    r+=write(*b++);
+  return(r);
+}
+
+size_t Print::printNumber(unsigned long n, int base){
+  char s[34];
+  char *p=s+sizeof(s)-1;
+
+  *p='\0';
+  do{
+    int d=n%base;
+    *--p=d<10?'0'+d:'A'+d-10;
+    n/=base;
+  } while(n>0);
+  return(write(p));
+}
+
+size_t Print::print(long n, int base){
+  if(n<0 && base==DEC)
+    return(write((uint8_t)'-')+printNumber(-n,base));
+  return(printNumber(n,base));
+}
+
+size_t Print::print(double x, int digits){
+  char s[32];
+  snprintf(s,sizeof(s),"%.*f",digits,x);
+  return(write(s));
+}
+
+size_t Print::print(const IPAddress &a){
+  char s[16];
+  snprintf(s,sizeof(s),"%d.%d.%d.%d",a.b[0],a.b[1],a.b[2],a.b[3]);
+  return(write(s));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int HardwareSerial::available(){
+  return(serialIn.size()-serialInPos);
+}
+
+int HardwareSerial::read(){
+  if(serialInPos==serialIn.size())
+    return(-1);
+  int c=(byte)serialIn[serialInPos++];
+  if(serialInPos==serialIn.size()){
+    serialIn.clear();
+    serialInPos=0;
+  }
+  return(c);
+}
+
+int HardwareSerial::availableForWrite(){
+  if(serialFree<=Sim::now)
+    return(SIM_SERIAL_TX_SIZE-1);
+  long n=SIM_SERIAL_TX_SIZE-1-(long)((serialFree-Sim::now+SIM_SERIAL_MICROS-1)/SIM_SERIAL_MICROS);
+  return(n>0?n:0);
+}
+
+size_t HardwareSerial::write(uint8_t c){
+  Sim::out+=(char)c;
+  serialFree=max(serialFree,Sim::now)+SIM_SERIAL_MICROS;
+  return(1);
+}
+
+size_t HardwareSerial::write(const uint8_t *b, size_t n){
+  return(Print::write(b,n));
+}
+
+void HardwareSerial::flush(){
+}
@@ -0,0 +1,76 @@
+/**********************************************************************
+
+Sim.h
+COPYRIGHT (c) 2013-2016 Gregg E. Berman
+
+Part of DCC++ BASE STATION for the Arduino
+
+**********************************************************************/
+
+#ifndef Sim_h
+#define Sim_h
+
+#include <string>
+#include <vector>
+#include "Arduino.h"
+
+// Define the tracks and the simulated hardware timing
+
+#define  SIM_MAIN                    0
+#define  SIM_PROG                    1
+
+#define  SIM_ADC_MICROS             54      // one ADC conversion (13.5 ADC clocks at 4 microseconds each)
+#define  SIM_SERIAL_MICROS          87      // one character at 115200 baud
+#define  SIM_SERIAL_TX_SIZE         64      // size of the Arduino core's serial transmit buffer
+#define  SIM_RESCUE_MILLIS           2      // wall-clock time a single loop() pass may spin before the interrupts are run alongside it
+
+struct SimPacket{
+  unsigned long long time;          // simulated time at which the packet end bit was sent
+  byte n;                           // number of bytes, including checksum
+  byte b[6];
+}; // SimPacket
+
+struct SimDecoder{
+  int ones;                         // preamble one bits counted so far
+  byte inPacket;
+  byte nBits;                       // data bits of the current byte received so far
+  byte n;
+  byte b[8];
+  unsigned long errors;             // packets with a bad checksum or too many bytes
+  void receive(int, int);
+}; // SimDecoder
+
+struct Sim{
+  static unsigned long long now;            // simulated time, in microseconds
+  static unsigned int loopMicros;           // simulated time taken by each pass through loop()
+  static unsigned long loops;               // passes through loop() so far
+  static unsigned long long isrTime[3];     // host nanoseconds spent in the Main Track, Programming Track, and ADC interrupts
+  static unsigned long isrCount[3];
+
+  static int load[2];                       // current drawn by each track while powered, in ADC counts
+  static int noise;                         // amplitude of pseudo-random noise added to every sample
+  static int ackLoad;                       // extra current drawn by the programming track decoder during an acknowledgement
+  static unsigned int ackMicros;            // length of an acknowledgement pulse
+  static byte ackRepeat;                    // set if the decoder acknowledges every repeat of a verify, rather than only the first pair
+  static byte cv[1024];                     // CVs of the decoder on the programming track
+  static unsigned long ackCount;
+  static unsigned long long ackStart, ackEnd;   // simulated time of the latest acknowledgement pulse
+
+  static std::vector<SimPacket> packets[2]; // every packet decoded from each track's waveform
+  static SimDecoder decoder[2];
+  static byte pins[64];
+  static std::string out;                   // everything written to the serial port
+
+  static void begin();
+  static void run(unsigned long);
+  static void stall(unsigned long);
+  static boolean runUntil(const char *, unsigned long);
+  static void send(const char *);
+  static void send(const byte *, int);
+  static std::string take();
+  static boolean powered(int);
+  static void packet(int, const byte *, int);
+  static void next(unsigned long long);
+}; // Sim
+
+#endif
@@ -0,0 +1,337 @@
+/**********************************************************************
+
+bench.cpp
+COPYRIGHT (c) 2013-2016 Gregg E. Berman
+
+Part of DCC++ BASE STATION for the Arduino
+
+**********************************************************************/
+/**********************************************************************
+
+Benchmarks of the sketch, run in the simulator.
+
+Results in simulated time (packet rates, refresh intervals, the delay from a command to its packet
+on the track, the time to cut power after a short circuit) follow the real bit timing and ADC rate,
+and carry over to the Arduino.
+
+Results in host nanoseconds (interrupt code, filter, command assembly and parsing) only compare
+one way of doing something against another on the same host.  The AVR has no cache, no FPU, and
+8-bit registers, so the ratios on the Arduino differ, sometimes widely.  For cycle counts of the
+DCC interrupts on the Arduino itself, build the sketch with ISR_TIMING set to 1 and use <I>.
+
+Where a benchmark compares against the code that was replaced, the earlier code is reproduced
+here as a reference, marked "before".
+
+**********************************************************************/
+
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "Sim.h"
+#include "DCCpp_Uno.h"
+#include "PacketRegister.h"
+#include "CurrentMonitor.h"
+#include "SerialCommand.h"
+
+extern volatile RegisterList mainRegs;
+
+#define  BENCH_CABS                 12      // cabs loaded on the Main Track for the refresh benchmark
+#define  BENCH_SECONDS              20      // simulated seconds of throttle traffic
+#define  BENCH_THROTTLE_MILLIS      25      // time between throttle commands
+
+static volatile long sink;          // keeps results of timed loops from being optimised away
+
+///////////////////////////////////////////////////////////////////////////////
+
+static unsigned long long hostNanos(){
+  return(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int speedByte(int speed){
+  return(speed+(speed>0)+128);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// RUNS BENCH_CABS CABS WITH A STEADY STREAM OF THROTTLE COMMANDS AND REPORTS THE PACKET RATE, THE DELAY FROM EACH COMMAND TO ITS
+// FIRST SPEED PACKET ON THE TRACK, THE LONGEST GAP BETWEEN SPEED PACKETS FOR ANY ONE CAB, AND HOW OFTEN loadPacket() HAD TO WAIT
+
+static void benchRefresh(){
+  char s[32];
+  std::vector<unsigned long long> delays;
+  unsigned long long sent[BENCH_CABS+1], lastSeen[BENCH_CABS+1], maxGap=0;
+  int speed[BENCH_CABS+1];
+  size_t k;
+
+  Sim::send("<1>");
+  for(int i=1;i<=BENCH_CABS;i++){
+    sprintf(s,"<t %d %d 10 1>",i,i+10);
+    Sim::send(s);
+    speed[i]=10;
+    sent[i]=0;
+  }
+  Sim::run(2000000);
+
+  k=Sim::packets[SIM_MAIN].size();
+  size_t k0=k;
+  unsigned long long start=Sim::now;
+  unsigned long oneShots=mainRegs.oneShotCount;
+  for(int i=1;i<=BENCH_CABS;i++)
+    lastSeen[i]=start;
+
+  for(int n=0;Sim::now-start<BENCH_SECONDS*1000000ULL;n++){
+    int c=n%BENCH_CABS+1;
+    speed[c]=(speed[c]+7)%120+1;
+    sprintf(s,"<t %d %d %d 1>",c,c+10,speed[c]);
+    Sim::send(s);
+    sent[c]=Sim::now;
+    Sim::run(BENCH_THROTTLE_MILLIS*1000);
+
+    for(;k<Sim::packets[SIM_MAIN].size();k++){
+      SimPacket &p=Sim::packets[SIM_MAIN][k];
+      int cab=p.b[0]-10;
+      if(p.n!=4 || p.b[1]!=0x3F || cab<1 || cab>BENCH_CABS)
+        continue;
+      maxGap=max(maxGap,p.time-lastSeen[cab]);
+      lastSeen[cab]=p.time;
+      if(sent[cab]>0 && p.b[2]==speedByte(speed[cab])){
+        delays.push_back(p.time-sent[cab]);
+        sent[cab]=0;
+      }
+    }
+  }
+
+  double seconds=(Sim::now-start)/1e6;
+  std::sort(delays.begin(),delays.end());
+  printf("refresh:  %d cabs, <t> every %d ms for %.0f s\n",BENCH_CABS,BENCH_THROTTLE_MILLIS,seconds);
+  printf("  packets/s on Main Track         %.1f\n",(Sim::packets[SIM_MAIN].size()-k0)/seconds);
+  printf("  <t> to speed packet on track    median %.1f ms, max %.1f ms (%d commands)\n",delays[delays.size()/2]/1000.0,delays.back()/1000.0,(int)delays.size());
+  printf("  longest gap between speed packets of one cab   %.1f ms\n",maxGap/1000.0);
+  printf("  loadPacket() waits for a full queue            %u\n",mainRegs.queueFullCount);
+  printf("  one-time packets                               %lu\n",mainRegs.oneShotCount-oneShots);
+} // benchRefresh
+
+///////////////////////////////////////////////////////////////////////////////
+
+// HOST TIME OF THE DCC AND ADC INTERRUPT CODE, AVERAGED OVER EVERY CALL MADE WHILE THE REFRESH BENCHMARK RAN
+
+static void benchInterrupts(){
+  const char *name[]={"Main Track DCC","Programming Track DCC","ADC sampling"};
+
+  printf("interrupts:  host ns per call\n");
+  for(int i=0;i<3;i++)
+    printf("  %-24s %6.1f ns  (%lu calls)\n",name[i],(double)Sim::isrTime[i]/Sim::isrCount[i],Sim::isrCount[i]);
+} // benchInterrupts
+
+///////////////////////////////////////////////////////////////////////////////
+
+// HOST TIME TO SELECT EACH BIT OF A PACKET:  BEFORE, AS AN INDEX INTO THE PACKET WITH A LOOKUP TABLE OF MASKS THROUGH TWO POINTERS,
+// AND NOW, AS A BYTE POINTER AND A SHIFTING MASK
+
+static void benchBitWalk(){
+  static byte bitMask[]={0x80,0x40,0x20,0x10,0x08,0x04,0x02,0x01};
+  Packet packet={{0xFF,0xFF,0xFC,0x0C,0x1F,0xD3,0x29,0x00,0x00,0x00},59};
+  Packet *active=&packet;
+  Packet **activePacket=&active;
+  const int nPasses=2000000;
+  unsigned long long t0;
+  long ones;
+
+  ones=0;
+  t0=hostNanos();
+  for(int n=0;n<nPasses;n++){
+    for(byte currentBit=0;currentBit<(*activePacket)->nBits;currentBit++)
+      if((*activePacket)->buf[currentBit/8] & bitMask[currentBit%8])
+        ones++;
+    sink=ones;
+  }
+  double before=(double)(hostNanos()-t0)/nPasses/packet.nBits;
+
+  ones=0;
+  t0=hostNanos();
+  for(int n=0;n<nPasses;n++){
+    byte *currentByte=(*activePacket)->buf;
+    byte currentMask=0x80;
+    for(byte bitsLeft=(*activePacket)->nBits;bitsLeft>0;bitsLeft--){
+      if(*currentByte & currentMask)
+        ones++;
+      currentMask>>=1;
+      if(currentMask==0){
+        currentMask=0x80;
+        currentByte++;
+      }
+    }
+    sink=ones;
+  }
+  double after=(double)(hostNanos()-t0)/nPasses/packet.nBits;
+
+  printf("bit selection:  host ns per bit\n");
+  printf("  before (index, mask table)      %.2f ns\n",before);
+  printf("  now (byte pointer, shift)       %.2f ns\n",after);
+} // benchBitWalk
+
+///////////////////////////////////////////////////////////////////////////////
+
+// HOST TIME PER SAMPLE OF THE FIXED-POINT FILTER, AGAINST THE FLOAT CALCULATION IT REPLACED
+
+static void benchFilter(){
+  const int nSamples=20000000;
+  ExpFilter f;
+  float x=0;
+  int v;
+  unsigned long long t0;
+
+  f.reset(0);
+  t0=hostNanos();
+  for(int i=0;i<nSamples;i++){
+    v=(i*37)&0x1FF;
+    sink=f.update(v,FILTER_WEIGHT(ACK_SAMPLE_SMOOTHING));
+  }
+  double fixed=(double)(hostNanos()-t0)/nSamples;
+
+  t0=hostNanos();
+  for(int i=0;i<nSamples;i++){
+    v=(i*37)&0x1FF;
+    x=ACK_SAMPLE_SMOOTHING*v+(1.0-ACK_SAMPLE_SMOOTHING)*x;
+    sink=(long)x;
+  }
+  double flt=(double)(hostNanos()-t0)/nSamples;
+
+  printf("filter:  host ns per sample (the host has an FPU, the AVR does not)\n");
+  printf("  before (float)                  %.2f ns\n",flt);
+  printf("  now (ExpFilter)                 %.2f ns\n",fixed);
+} // benchFilter
+
+///////////////////////////////////////////////////////////////////////////////
+
+// SIMULATED TIME FROM A STEP INCREASE IN MAIN TRACK CURRENT TO POWER BEING CUT, FOR A DEAD SHORT (FAST TRIP IN THE ADC INTERRUPT)
+// AND FOR OVERLOADS BELOW CURRENT_FAST_TRIP_MAX (SMOOTHED TRIP IN CurrentMonitor::check())
+
+static void benchTrip(){
+  int loads[]={1023,CURRENT_FAST_TRIP_MAX+50,CURRENT_SAMPLE_MAX*2,CURRENT_SAMPLE_MAX+50};
+
+  printf("overcurrent:  time from step overload to Main Track power cut\n");
+  for(unsigned int i=0;i<sizeof(loads)/sizeof(int);i++){
+    Sim::load[SIM_MAIN]=20;
+    Sim::send("<1>");
+    Sim::run(1000000);
+    Sim::load[SIM_MAIN]=loads[i];
+    unsigned long long t=Sim::now;
+    while(Sim::powered(SIM_MAIN) && Sim::now-t<5000000)
+      Sim::run(Sim::loopMicros);
+    if(Sim::powered(SIM_MAIN))
+      printf("  load %4d                      no trip in 5 s\n",loads[i]);
+    else
+      printf("  load %4d                      %.2f ms\n",loads[i],(Sim::now-t)/1000.0);
+    Sim::send("<0>");
+    Sim::run(100000);
+  }
+  Sim::load[SIM_MAIN]=20;
+} // benchTrip
+
+///////////////////////////////////////////////////////////////////////////////
+
+// HOST THROUGHPUT OF COMMAND ASSEMBLY:  BEFORE, APPENDING EACH CHARACTER WITH sprintf() AFTER A strlen(), AND NOW, CommandBuffer::add()
+
+static void benchAssembly(){
+  const char *text="<t 1 3 50 1><f 3 144><a 12 1 1><T 7 1><R 29 7 8>";
+  const int nPasses=500000;
+  int len=strlen(text);
+  char commandString[MAX_COMMAND_LENGTH+1];
+  CommandBuffer buf;
+  unsigned long long t0;
+  long n;
+
+  n=0;
+  commandString[0]='\0';
+  t0=hostNanos();
+  for(int k=0;k<nPasses;k++){
+    for(int i=0;i<len;i++){
+      char c=text[i];
+      if(c=='<')
+        sprintf(commandString,"");
+      else if(c=='>')
+        n+=commandString[0];
+      else if(strlen(commandString)<MAX_COMMAND_LENGTH)
+        sprintf(commandString,"%s%c",commandString,c);
+    }
+    sink=n;
+  }
+  double before=(double)nPasses*len*1e9/(hostNanos()-t0);
+
+  n=0;
+  buf.reset();
+  t0=hostNanos();
+  for(int k=0;k<nPasses;k++){
+    for(int i=0;i<len;i++)
+      if(buf.add(text[i])==COMMAND_TEXT)
+        n+=buf.buf[0];
+    sink=n;
+  }
+  double after=(double)nPasses*len*1e9/(hostNanos()-t0);
+
+  printf("command assembly:  host bytes per second\n");
+  printf("  before (sprintf per character)  %.3g\n",before);
+  printf("  now (CommandBuffer::add)        %.3g\n",after);
+} // benchAssembly
+
+///////////////////////////////////////////////////////////////////////////////
+
+// HOST TIME TO DECODE THE PARAMETERS OF <t 1 3 50 1>:  BEFORE, WITH sscanf(), AND NOW, WITH parseParams().  ALSO THE TIME OF THE WHOLE
+// COMMAND FROM parse() THROUGH setThrottle() AND loadPacket(), WITH THE UPDATE QUEUE EMPTIED AFTER EACH CALL AS THE INTERRUPT WOULD
+
+static void benchParams(){
+  const int nPasses=2000000;
+  int p[MAX_COMMAND_PARAMS];
+  int a,b,c,d;
+  char s[MAX_COMMAND_LENGTH+1];
+  unsigned long long t0;
+
+  t0=hostNanos();
+  for(int k=0;k<nPasses;k++){
+    strcpy(s," 1 3 50 1");
+    sink=sscanf(s,"%d %d %d %d",&a,&b,&c,&d)+a+b+c+d;
+  }
+  double before=(double)(hostNanos()-t0)/nPasses;
+
+  t0=hostNanos();
+  for(int k=0;k<nPasses;k++){
+    strcpy(s," 1 3 50 1");
+    sink=SerialCommand::parseParams(s,p,false)+p[0]+p[1]+p[2]+p[3];
+  }
+  double after=(double)(hostNanos()-t0)/nPasses;
+
+  const int nCommands=200000;
+  t0=hostNanos();
+  for(int k=0;k<nCommands;k++){
+    strcpy(s,"t 1 3 50 1");
+    SerialCommand::parse(s);
+    mainRegs.queueTail=mainRegs.queueHead;
+    outputBuffer.head=outputBuffer.tail=outputBuffer.frameStart=outputBuffer.frameEnd=0;
+  }
+  double whole=(double)(hostNanos()-t0)/nCommands;
+
+  printf("<t> parameters:  host ns per command\n");
+  printf("  before (sscanf)                 %.1f ns\n",before);
+  printf("  now (parseParams)               %.1f ns\n",after);
+  printf("  whole <t> command, now          %.1f ns\n",whole);
+} // benchParams
+
+///////////////////////////////////////////////////////////////////////////////
+
+int main(){
+  setvbuf(stdout,NULL,_IOLBF,0);
+
+  Sim::begin();
+  benchRefresh();
+  benchInterrupts();
+  benchTrip();
+  Sim::take();
+  benchBitWalk();
+  benchFilter();
+  benchAssembly();
+  benchParams();
+  return(0);
+} // main
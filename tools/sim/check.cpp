@@ -0,0 +1,519 @@
+/**********************************************************************
+
+check.cpp
+COPYRIGHT (c) 2013-2016 Gregg E. Berman
+
+Part of DCC++ BASE STATION for the Arduino
+
+**********************************************************************/
+/**********************************************************************
+
+Regression checks for the sketch, run in the simulator.  Each check starts a fresh copy of the sketch
+in its own process, drives it only through the serial port and the simulated tracks, and looks at the
+responses and at the packets decoded from the track waveforms.
+
+  build/check_uno [NAME]     runs every check, or only the named check, for the Uno
+  build/check_mega [NAME]    the same for the Mega
+
+**********************************************************************/
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include "Sim.h"
+#include "DCCpp_Uno.h"
+#include "PacketRegister.h"
+#include "CurrentMonitor.h"
+#include "Sensor.h"
+#include "Filter.h"
+#include "SerialCommand.h"
+
+extern volatile RegisterList mainRegs;
+extern volatile RegisterList progRegs;
+
+static int failed;
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void expect(boolean ok, const char *what){
+  if(!ok){
+    printf("    FAILED: %s\n",what);
+    failed=1;
+  }
+} // expect
+
+///////////////////////////////////////////////////////////////////////////////
+
+// SENDS A COMMAND AND RUNS UNTIL reply APPEARS IN THE OUTPUT (OR maxMs PASSES), RETURNING EVERYTHING PRINTED SINCE THE COMMAND WAS SENT
+
+static std::string command(const char *s, const char *reply, unsigned long maxMs=1000){
+  Sim::take();
+  Sim::send(s);
+  Sim::runUntil(reply,maxMs*1000);
+  std::string r=Sim::take();
+  printf("    %s -> %s\n",s,r.c_str());
+  return(r);
+} // command
+
+///////////////////////////////////////////////////////////////////////////////
+
+// RETURNS THE TIME OF THE FIRST PACKET ON track AFTER time t THAT MATCHES THE n BYTES IN b (NOT COUNTING THE CHECKSUM), OR 0 IF NONE
+
+static unsigned long long findPacket(int track, unsigned long long t, const byte *b, int n){
+  for(size_t i=0;i<Sim::packets[track].size();i++){
+    SimPacket &p=Sim::packets[track][i];
+    if(p.time>=t && p.n==n+1 && memcmp(p.b,b,n)==0)
+      return(p.time);
+  }
+  return(0);
+} // findPacket
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int countPackets(int track, unsigned long long t, const byte *b, int n){
+  int count=0;
+  for(size_t i=0;i<Sim::packets[track].size();i++){
+    SimPacket &p=Sim::packets[track][i];
+    if(p.time>=t && p.n==n+1 && memcmp(p.b,b,n)==0)
+      count++;
+  }
+  return(count);
+} // countPackets
+
+///////////////////////////////////////////////////////////////////////////////
+// CHECKS
+///////////////////////////////////////////////////////////////////////////////
+
+// THE WAVEFORM OF BOTH TRACKS DECODES INTO VALID IDLE PACKETS
+
+static void checkWaveform(){
+  byte idle[]={0xFF,0x00};
+
+  Sim::run(1000000);
+  printf("    %d Main Track and %d Programming Track packets in 1 s, %lu and %lu errors\n",(int)Sim::packets[SIM_MAIN].size(),
+    (int)Sim::packets[SIM_PROG].size(),Sim::decoder[SIM_MAIN].errors,Sim::decoder[SIM_PROG].errors);
+  expect(Sim::decoder[SIM_MAIN].errors==0 && Sim::decoder[SIM_PROG].errors==0,"packets decode with valid checksums");
+  expect(countPackets(SIM_MAIN,0,idle,2)>100,"Main Track sends idle packets");
+  expect(countPackets(SIM_PROG,0,idle,2)>100,"Programming Track sends idle packets");
+} // checkWaveform
+
+///////////////////////////////////////////////////////////////////////////////
+
+// A THROTTLE COMMAND IS ANSWERED, AND ITS SPEED PACKET REACHES THE TRACK WITHIN A FEW PACKET TIMES EVEN WITH OTHER CABS LOADED
+
+static void checkThrottle(){
+  char s[32];
+  byte b[]={3,0x3F,0xB3};
+  unsigned long long t;
+
+  command("<1>","<p1>");
+  for(int i=1;i<=10;i++){
+    sprintf(s,"<t %d %d 20 1>",i,i+10);
+    Sim::send(s);
+  }
+  Sim::run(1000000);
+  t=Sim::now;
+  expect(command("<t 3 3 50 1>","<T3 50 1>").find("<T3 50 1>")!=std::string::npos,"<t> is answered with <T>");
+  Sim::run(100000);
+  unsigned long long seen=findPacket(SIM_MAIN,t,b,3);
+  printf("    speed packet on track %llu us after <t>\n",seen-t);
+  expect(seen>0 && seen-t<30000,"new speed is sent within a few packet times");
+  printf("    sent %d times in the next 100 ms\n",countPackets(SIM_MAIN,t,b,3));
+  expect(countPackets(SIM_MAIN,t,b,3)>=1+PRIORITY_REFRESH_COUNT,"new speed is repeated ahead of the refresh cycle");
+} // checkThrottle
+
+///////////////////////////////////////////////////////////////////////////////
+
+// A STEADY STREAM OF THROTTLE CHANGES FOR A FEW CABS DOES NOT STARVE THE REFRESH OF THE OTHERS:  EVERY REGISTER IS STILL SENT AT LEAST ONCE
+// IN EVERY (PRIORITY_BURST_MAX+1) PACKETS PER LOADED REGISTER
+
+static void checkStarve(){
+  char s[32];
+  size_t k, last[MAX_MAIN_REGISTERS+1];
+  size_t maxGap=0;
+  unsigned long long t;
+
+  command("<1>","<p1>");
+  for(int i=1;i<=MAX_MAIN_REGISTERS;i++){
+    sprintf(s,"<t %d %d 10 1>",i,i+10);
+    Sim::send(s);
+  }
+  Sim::run(1000000);
+
+  k=Sim::packets[SIM_MAIN].size();
+  for(int i=1;i<=MAX_MAIN_REGISTERS;i++)
+    last[i]=k;
+  t=Sim::now;
+  for(int n=0;Sim::now-t<3000000;n++){            // cabs 11 and 12 change speed every 10 ms, faster than their priority re-sends can be sent
+    sprintf(s,"<t %d %d %d 1>",n%2+1,n%2+11,n%100+1);
+    Sim::send(s);
+    Sim::run(10000);
+  }
+
+  for(;k<Sim::packets[SIM_MAIN].size();k++){
+    SimPacket &p=Sim::packets[SIM_MAIN][k];
+    int r=p.b[0]-10;
+    if(p.n!=4 || p.b[1]!=0x3F || r<3 || r>MAX_MAIN_REGISTERS)
+      continue;
+    maxGap=max(maxGap,k-last[r]);
+    last[r]=k;
+  }
+  for(int i=3;i<=MAX_MAIN_REGISTERS;i++)
+    maxGap=max(maxGap,k-last[i]);
+  printf("    longest gap between refreshes of an unchanged cab: %d packets\n",(int)maxGap);
+  expect(maxGap<=(MAX_MAIN_REGISTERS+1)*(PRIORITY_BURST_MAX+1),"refresh cycle is not starved by priority packets");
+} // checkStarve
+
+///////////////////////////////////////////////////////////////////////////////
+
+// A REGISTER LOADED FOR THE FIRST TIME WHILE THE UPDATE QUEUE IS HELD BACK BY THE BURST LIMIT IS NOT SENT BY THE REFRESH CYCLE BEFORE ITS
+// FIRST PACKET HAS BEEN TAKEN FROM THE QUEUE
+
+static void checkNewRegs(){
+  char s[64];
+  byte b[]={0,0x3F,0x8B};
+  byte maxBits=0;
+  int nFound=0;
+  unsigned long long t;
+
+  command("<1>","<p1>");
+  for(int i=3;i<=MAX_MAIN_REGISTERS;i++){
+    for(int n=0;n<20;n++){                        // cabs 11 and 12 change speed every 5 ms, and a new register is loaded among them
+      sprintf(s,"<t 1 11 %d 1><t 2 12 %d 1>",n+i+1,n+i+2);
+      if(n==10)
+        sprintf(s+strlen(s),"<t %d %d 10 1>",i,i+10);
+      Sim::send(s);
+      for(t=Sim::now;Sim::now-t<5000;){
+        Sim::run(Sim::loopMicros);
+        maxBits=max(maxBits,mainRegs.bitsLeft);
+      }
+    }
+  }
+  Sim::run(100000);
+
+  printf("    largest bit count of a Main Track packet: %d, %lu errors\n",maxBits,Sim::decoder[SIM_MAIN].errors);
+  expect(maxBits<=MAIN_PREAMBLE_BITS+54 && Sim::decoder[SIM_MAIN].errors==0,"no packet is sent from a register before it is loaded");
+  for(int i=3;i<=MAX_MAIN_REGISTERS;i++){
+    b[0]=i+10;
+    nFound+=(findPacket(SIM_MAIN,0,b,3)>0);
+  }
+  expect(nFound==MAX_MAIN_REGISTERS-2,"every new register is sent");
+} // checkNewRegs
+
+///////////////////////////////////////////////////////////////////////////////
+
+// AUTOMATIC REGISTER SELECTION NEVER TAKES A REGISTER WRITTEN WITH <M>, AND A CAB SET INTO A NEW REGISTER IS NO LONGER SENT FROM ITS OLD ONE
+
+static void checkCabs(){
+  char s[32];
+  byte raw[]={0x05,0x3F,0x85};
+  byte old[]={0x03,0x3F,0x95};
+  std::string r;
+
+  command("<1>","<p1>");
+  Sim::send("<M 2 05 3F 85>");
+  for(int i=1;i<=MAX_MAIN_REGISTERS+4;i++){       // more cabs than registers, all stopped, so every register not holding a raw packet is used
+    sprintf(s,"<t %d 0 1>",i+100);
+    r+=command(s," 1>");
+  }
+  expect(r.find("<T2 ")==std::string::npos,"register written with <M> is not selected");
+  Sim::run(1000000);
+  expect(findPacket(SIM_MAIN,Sim::now-500000,raw,3)>0,"raw packet is still refreshed");
+
+  r=command("<t 3 20 1>"," 1>");
+  command("<t 9 3 30 1>"," 1>");
+  if(r.find("<T9 ")==std::string::npos){
+    Sim::run(1000000);
+    expect(countPackets(SIM_MAIN,Sim::now-500000,old,3)==0,"cab's old register is released when it is set into a new one");
+  }
+  expect(command("<t 3 40 1>"," 1>").find("<T9 40 1>")!=std::string::npos,"cab is found in its new register");
+} // checkCabs
+
+///////////////////////////////////////////////////////////////////////////////
+
+// CVS ARE READ, WRITTEN BYTE BY BYTE AND BIT BY BIT, AND A CV THE DECODER DOES NOT ACKNOWLEDGE READS AS -1
+
+static void checkCV(){
+  Sim::cv[28]=0xA5;
+  Sim::cv[6]=0;
+
+  command("<1>","<p1>");
+  expect(command("<R 29 7 8>","<r",3000).find("<r7|8|29 165>")!=std::string::npos,"<R> reads a CV");
+  expect(command("<W 7 77 2 3>","<r",3000).find("<r2|3|7 77>")!=std::string::npos && Sim::cv[6]==77,"<W> writes a CV");
+  expect(command("<B 7 1 1 4 5>","<r",3000).find("<r4|5|7 1 1>")!=std::string::npos && Sim::cv[6]==79,"<B> writes a CV bit");
+  expect(command("<R 7 1 1>","<r",3000).find("<r1|1|7 79>")!=std::string::npos,"<R> reads back written CV");
+  Sim::ackLoad=0;
+  expect(command("<R 30 1 1>","<r",3000).find("<r1|1|30 -1>")!=std::string::npos,"no acknowledgement gives -1");
+} // checkCV
+
+///////////////////////////////////////////////////////////////////////////////
+
+// RUNS AN ExpFILTER AND THE FLOAT CALCULATION IT REPLACES OVER nSamples PSEUDO-RANDOM STEPS BETWEEN lo AND hi, AND CHECKS THAT THEY AGREE TO
+// WITHIN ONE COUNT, AND THAT THE PRODUCT IN update() FITS THE 32-BIT long OF THE AVR (THE HOST long IS WIDER, SO IT IS CHECKED HERE DIRECTLY)
+
+static void checkWeight(const char *name, float w, int weight, int lo, int hi){
+  ExpFilter f;
+  float x=lo;
+  int v=lo, maxError=0;
+  long long product, maxProduct=0;
+  unsigned long r=1;
+
+  f.reset(lo);
+  for(int i=0;i<200000;i++){
+    r=r*1103515245+12345;
+    if((r>>16)%64==0)                           // hold each level for a while, with full swings between the two ends
+      v=((r>>24)&1)?hi:lo;
+    else if((r>>16)%8==0)
+      v=lo+(int)((r>>8)%(hi-lo+1));
+    product=(((long long)v<<FILTER_VALUE_BITS)-f.value)*weight;
+    maxProduct=max(maxProduct,product<0?-product:product);
+    x=w*v+(1.0-w)*x;
+    int e=abs(f.update(v,weight)-(int)floor(x));     // max() is a macro, so update() is kept out of it
+    maxError=max(maxError,e);
+  }
+  printf("    %-28s weight %.2f, samples %d to %d: largest error %d, largest product %.4f x 2^31\n",name,w,lo,hi,maxError,maxProduct/2147483648.0);
+  expect(maxError<=1,"fixed point agrees with float to within one count");
+  expect(maxProduct<2147483648LL,"product fits in a 32-bit long");
+} // checkWeight
+
+// THE FIXED-POINT FILTER AGREES WITH FLOAT FOR EVERY WEIGHT AND SAMPLE RANGE THE SKETCH USES, AND AT THE DOCUMENTED LIMIT
+
+static void checkFilter(){
+  checkWeight("CURRENT_SAMPLE_SMOOTHING",CURRENT_SAMPLE_SMOOTHING,FILTER_WEIGHT(CURRENT_SAMPLE_SMOOTHING),0,1023);
+  checkWeight("ACK_SAMPLE_SMOOTHING",ACK_SAMPLE_SMOOTHING,FILTER_WEIGHT(ACK_SAMPLE_SMOOTHING),-1023,1023);
+  checkWeight("SENSOR_DECAY",SENSOR_DECAY,FILTER_WEIGHT(SENSOR_DECAY),0,SENSOR_SCALE);
+  checkWeight("limit",0.5,FILTER_WEIGHT(0.5),-2047,2047);
+} // checkFilter
+
+///////////////////////////////////////////////////////////////////////////////
+
+// A CV IS STILL READ CORRECTLY WHEN A SLOW PASS OF loop() LETS SAMPLES BE OVERWRITTEN WHILE WAITING FOR AN ACKNOWLEDGEMENT.  A DECODER THAT
+// ACKNOWLEDGES EVERY REPEAT OF A VERIFY SENDS PULSES WITH SHORT GAPS BETWEEN THEM, AND HERE THE FIRST FEW PULSES ARE EACH CUT BY A STALL THAT
+// LASTS INTO THE NEXT ONE, SO THAT COUNTING THE MISSED SAMPLES WOULD MERGE THE PULSES INTO ONE THAT IS TOO LONG
+
+static void checkStall(){
+  unsigned long long t,lastStart=0;
+  int nStalls=0;
+
+  Sim::cv[0]=3;
+  Sim::ackRepeat=1;
+
+  command("<1>","<p1>");
+  Sim::take();
+  Sim::send("<R 1 1 1>");
+  t=Sim::now;
+  while(Sim::out.find("<r")==std::string::npos && Sim::now-t<3000000){
+    Sim::run(Sim::loopMicros);
+    if(Sim::ackStart!=lastStart && Sim::now>=Sim::ackStart+2000 && nStalls<ACK_RETRY_MAX){
+      lastStart=Sim::ackStart;
+      Sim::stall(CURRENT_SAMPLER_SIZE*ACK_SAMPLE_MICROS+9000);    // from early in the pulse until well into the next one
+      nStalls++;
+    }
+  }
+  Sim::runUntil(">",10000);
+  std::string r=Sim::take();
+  printf("    <R 1 1 1> with %d stalls across acknowledgements -> %s\n",nStalls,r.c_str());
+  expect(r.find("<r1|1|1 3>")!=std::string::npos,"CV is read despite missed samples");
+} // checkStall
+
+///////////////////////////////////////////////////////////////////////////////
+
+// CALIBRATION IS REFUSED WITHOUT A DECODER ON A POWERED PROGRAMMING TRACK, AND ONLY GOES BELOW THE DEFAULT THRESHOLD WITH <A 2>
+
+static void checkCalibrate(){
+  char s[32];
+  std::string r;
+
+  sprintf(s,"<k0 0 %d>",ACK_SAMPLE_THRESHOLD);
+  expect(command("<A 1>",">",3000).find("<X>")!=std::string::npos,"<A 1> is refused with power off");
+  expect(command("<A>",">").find(s)!=std::string::npos,"threshold is kept");
+  command("<1>","<p1>");
+  Sim::load[SIM_PROG]=0;
+  expect(command("<A 1>",">",3000).find("<X>")!=std::string::npos,"<A 1> is refused with no decoder load");
+  Sim::load[SIM_PROG]=20;
+  sprintf(s," %d>",ACK_SAMPLE_THRESHOLD);
+  expect(command("<A 1>","<k",3000).find(s)!=std::string::npos,"<A 1> does not go below the default threshold");
+  r=command("<A 2>","<k",3000);
+  expect(r.find("<k")!=std::string::npos && r.find(s)==std::string::npos,"<A 2> sets a lower threshold");
+  Sim::cv[0]=3;
+  expect(command("<R 1 1 1>","<r",3000).find("<r1|1|1 3>")!=std::string::npos,"CVs read with the lower threshold");
+} // checkCalibrate
+
+///////////////////////////////////////////////////////////////////////////////
+
+// A BATCH READ KEEPS THE DECODER IN SERVICE MODE, AND A COMMAND SENT AS SOON AS ITS LAST <r> ARRIVES IS NOT REFUSED AS BUSY
+
+static void checkBatch(){
+  byte idle[]={0xFF,0x00};
+  std::string r;
+
+  Sim::cv[0]=3;
+  Sim::cv[1]=12;
+  Sim::cv[2]=34;
+
+  command("<1>","<p1>");
+  r=command("<R 1 3 5 6>","<r5|6|3 ",10000);
+  expect(r.find("<r5|6|1 3><r5|6|2 12><r5|6|3 34>")!=std::string::npos,"<R> reads a batch of CVs");
+  r=command("<R 2 7 8>","<r7|8|",3000);
+  expect(r.find("<r7|8|2 12>")!=std::string::npos,"read right after a batch read is not refused");
+  Sim::run(100000);
+  expect(findPacket(SIM_PROG,Sim::now-50000,idle,2)>0,"idle packets are restored afterwards");
+} // checkBatch
+
+///////////////////////////////////////////////////////////////////////////////
+
+// ADDING A CAB TO A CONSIST STOPS ITS OWN REGISTER WITHOUT A <T> REPLY, AND THE OLD SPEED PACKET LEAVES THE REFRESH CYCLE
+
+static void checkConsist(){
+  byte stop[]={3,0x3F,0x80};
+  byte cv19[]={3,0xEC,18,10};
+  int nWrites=0;
+  unsigned long long t;
+  std::string r;
+
+  command("<1>","<p1>");
+  command("<t 1 3 50 1>","<T1 50 1>");
+  Sim::run(100000);
+  t=Sim::now;
+  r=command("<C 10 3 1>","<O>");
+  expect(r.find("<T")==std::string::npos,"<C> does not print <T>");
+  Sim::run(500000);
+  expect(findPacket(SIM_MAIN,t,stop,3)>0,"cab is sent speed 0");
+  expect(findPacket(SIM_MAIN,t,cv19,4)>0,"CV19 is written");
+  expect(countPackets(SIM_MAIN,Sim::now-200000,stop,2)==0,"cab's packets are no longer refreshed");
+
+  t=Sim::now;
+  expect(command("<C 10 10294 1>",">").find("<X>")!=std::string::npos,"cab above 10293 is refused");
+  expect(command("<C 0>",">").find("<X>")!=std::string::npos,"cab 0 is refused");
+  Sim::run(200000);
+  for(size_t i=0;i<Sim::packets[SIM_MAIN].size();i++){
+    SimPacket &q=Sim::packets[SIM_MAIN][i];
+    if(q.time>=t && q.n>=4 && (q.b[q.n-4]&0xFC)==0xEC && q.b[q.n-3]==18)
+      nWrites++;
+  }
+  expect(nWrites==0,"CV19 is not written for a refused cab");
+} // checkConsist
+
+///////////////////////////////////////////////////////////////////////////////
+
+// AN EMERGENCY STOP CUTS IN AT THE NEXT PACKET BOUNDARY EVEN WHILE A ONE-TIME PACKET IS BEING REPEATED, AND THAT PACKET IS STILL SENT
+// IN FULL ONCE THE EMERGENCY STOP PACKETS HAVE GONE OUT
+
+static void checkEstop(){
+  byte w[]={3,0xEC,4,10};
+  byte stop[]={0,0x3F,0x01};
+  unsigned long long t, tStop;
+
+  command("<1>","<p1>");
+  command("<t 1 3 50 1>","<T1 50 1>");
+  Sim::run(100000);
+  t=Sim::now;
+  Sim::send("<w 3 5 10>");
+  while(countPackets(SIM_MAIN,t,w,4)<2 && Sim::now-t<100000)
+    Sim::run(Sim::loopMicros);
+  command("<!>","<O>");
+  Sim::run(200000);
+
+  tStop=findPacket(SIM_MAIN,t,stop,3);
+  printf("    CV write sent %d times, %d of them after the emergency stop\n",countPackets(SIM_MAIN,t,w,4),countPackets(SIM_MAIN,tStop,w,4));
+  expect(tStop>0 && countPackets(SIM_MAIN,t,stop,3)>=1+ESTOP_REPEAT_COUNT,"emergency stop is sent");
+  expect(countPackets(SIM_MAIN,tStop,w,4)>0,"emergency stop cuts in while the CV write is repeated");
+  expect(countPackets(SIM_MAIN,t,w,4)==5,"CV write is still sent in full");
+} // checkEstop
+
+///////////////////////////////////////////////////////////////////////////////
+
+// BINARY FRAMES ARE CARRIED OUT LIKE THE SAME TEXT COMMAND, AND A PARAMETER THAT DOES NOT FIT IN 16 BITS IS REJECTED RATHER THAN TRUNCATED
+
+static void checkBinary(){
+  byte t[]={BINARY_START_BYTE,0x06,'t',0x02,0x06,0x80,0x01,0x02,0x1B};     // <t 1 3 64 1>, as given in SerialCommand.cpp
+  byte big[]={BINARY_START_BYTE,0x07,'t',0x82,0x80,0x04,0x06,0x14,0x02,0};  // register 32769, which is register 1 if cut to 16 bits
+  std::string r;
+
+  command("<1>","<p1>");
+  Sim::send(t,sizeof(t));
+  Sim::run(100000);
+  r=Sim::take();
+  printf("    <t 1 3 64 1> as a binary frame -> %s\n",r.c_str());
+  expect(r.find("<T1 64 1>")!=std::string::npos,"binary frame is carried out");
+
+  big[sizeof(big)-1]=SerialCommand::crc8(big+1,big[1]+1);
+  Sim::send(big,sizeof(big));
+  Sim::run(100000);
+  r=Sim::take();
+  printf("    <t 32769 3 10 1> as a binary frame -> %s\n",r.c_str());
+  expect(r.find("<X>")!=std::string::npos && r.find("<T")==std::string::npos,"parameter larger than 16 bits is rejected");
+} // checkBinary
+
+///////////////////////////////////////////////////////////////////////////////
+
+// A SHORT CIRCUIT ON ONE TRACK CUTS ITS POWER WITHIN A MILLISECOND, AND ONLY THAT TRACK'S POWER
+
+static void checkFastTrip(){
+  unsigned long long t;
+
+  command("<1>","<p1>");
+  Sim::run(100000);
+  Sim::load[SIM_MAIN]=1000;
+  t=Sim::now;
+  while(Sim::powered(SIM_MAIN) && Sim::now-t<100000)
+    Sim::run(Sim::loopMicros);
+  printf("    Main Track power cut %llu us after short circuit\n",Sim::now-t);
+  expect(!Sim::powered(SIM_MAIN) && Sim::now-t<1000,"short circuit cuts power within 1 ms");
+  expect(Sim::powered(SIM_PROG),"Programming Track stays powered");
+  Sim::run(10000);
+  expect(Sim::take().find("<p2>")!=std::string::npos,"overload is reported with <p2>");
+} // checkFastTrip
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct Check{
+  const char *name;
+  void (*run)();
+}; // Check
+
+static Check checks[]={
+  {"waveform",checkWaveform},
+  {"filter",checkFilter},
+  {"throttle",checkThrottle},
+  {"starve",checkStarve},
+  {"newregs",checkNewRegs},
+  {"cabs",checkCabs},
+  {"cv",checkCV},
+  {"stall",checkStall},
+  {"calibrate",checkCalibrate},
+  {"batch",checkBatch},
+  {"consist",checkConsist},
+  {"estop",checkEstop},
+  {"binary",checkBinary},
+  {"fasttrip",checkFastTrip},
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv){
+  int nFailed=0;
+
+  setvbuf(stdout,NULL,_IOLBF,0);
+
+  for(unsigned int i=0;i<sizeof(checks)/sizeof(Check);i++){
+    if(argc>1 && strcmp(argv[1],checks[i].name)!=0)
+      continue;
+    printf("%s\n",checks[i].name);
+    pid_t pid=fork();
+    if(pid==0){                   // each check runs on a freshly started sketch
+      Sim::begin();
+      Sim::take();
+      checks[i].run();
+      _exit(failed);
+    }
+    int status;
+    waitpid(pid,&status,0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status)!=0){
+      printf("  FAILED\n");
+      nFailed++;
+    }
+  }
+
+  printf(nFailed?"%d FAILED\n":"ALL PASSED\n",nFailed);
+  return(nFailed>0);
+} // main
@@ -0,0 +1,136 @@
+/**********************************************************************
+
+Arduino.h
+COPYRIGHT (c) 2013-2016 Gregg E. Berman
+
+Part of DCC++ BASE STATION for the Arduino
+
+**********************************************************************/
+
+// HOST STAND-IN FOR THE ARDUINO CORE, JUST LARGE ENOUGH TO COMPILE THE SKETCH FOR THE SIMULATOR.  THE AVR REGISTERS USED BY THE
+// SKETCH ARE PLAIN VARIABLES THAT THE SIMULATOR READS (OCRnA, ADMUX) AND WRITES (ADC).  THE FUNCTIONS ARE DEFINED IN Sim.cpp.
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH            1
+#define LOW             0
+#define INPUT           0
+#define OUTPUT          1
+#define INPUT_PULLUP    2
+
+#define DEC            10
+#define HEX            16
+
+#define A0             14
+#define A1             15
+#define A2             16
+#define A3             17
+#define A4             18
+#define A5             19
+
+#define bitRead(v,b)      (((v)>>(b))&1)
+#define bitSet(v,b)       ((v)|=(1UL<<(b)))
+#define bitClear(v,b)     ((v)&=~(1UL<<(b)))
+#define bitWrite(v,b,x)   ((x)?bitSet(v,b):bitClear(v,b))
+#define bit(b)            (1UL<<(b))
+#define highByte(w)       ((uint8_t)((w)>>8))
+#define lowByte(w)        ((uint8_t)((w)&0xFF))
+#ifndef max
+  #define max(a,b)        ((a)>(b)?(a):(b))
+  #define min(a,b)        ((a)<(b)?(a):(b))
+#endif
+#define constrain(a,l,h)  ((a)<(l)?(l):((a)>(h)?(h):(a)))
+
+#define ISR(v)            void v()
+#define PROGMEM
+#define F(s)              s
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long);
+void delayMicroseconds(unsigned int);
+void pinMode(uint8_t, uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+int digitalRead(uint8_t);
+int analogRead(uint8_t);
+void noInterrupts();
+void interrupts();
+
+#define cli()             noInterrupts()
+#define sei()             interrupts()
+
+// AVR REGISTERS
+
+extern volatile uint16_t OCR1A, OCR1B, OCR3A, OCR3B, TCNT1, TCNT3;
+extern volatile uint8_t OCR0A, OCR0B, TCNT0;
+extern volatile uint8_t TCCR0A, TCCR0B, TCCR1A, TCCR1B, TCCR3A, TCCR3B, TIMSK0, TIMSK1, TIMSK3, CLKPR;
+extern volatile uint8_t ADCSRA, ADCSRB, ADMUX;
+extern volatile uint16_t ADC;
+
+enum{ WGM00=0, WGM01=1, WGM02=3, COM0B0=4, COM0B1=5, CS00=0, CS01=1, CS02=2, OCIE0B=2,
+      WGM10=0, WGM11=1, WGM12=3, WGM13=4, COM1B0=4, COM1B1=5, CS10=0, CS11=1, CS12=2, OCIE1B=2,
+      WGM30=0, WGM31=1, WGM32=3, WGM33=4, COM3B0=4, COM3B1=5, CS30=0, CS31=1, CS32=2, OCIE3B=2,
+      ADEN=7, ADSC=6, ADATE=5, ADIF=4, ADIE=3, ADPS2=2, ADPS1=1, ADPS0=0, REFS0=6, REFS1=7 };
+
+#ifndef ARDUINO_AVR_UNO
+  #define MUX5 3
+#endif
+
+// PRINT AND SERIAL
+
+struct IPAddress{
+  byte b[4];
+};
+
+class Print{
+  size_t printNumber(unsigned long, int);
+public:
+  virtual size_t write(uint8_t)=0;
+  virtual size_t write(const uint8_t *, size_t);
+  size_t write(const char *s){ return(write((const uint8_t *)s,strlen(s))); }
+  size_t print(const char *s){ return(write(s)); }
+  size_t print(char c){ return(write((uint8_t)c)); }
+  size_t print(unsigned char n, int base=DEC){ return(printNumber(n,base)); }
+  size_t print(int n, int base=DEC){ return(print((long)n,base)); }
+  size_t print(unsigned int n, int base=DEC){ return(printNumber(n,base)); }
+  size_t print(long, int=DEC);
+  size_t print(unsigned long n, int base=DEC){ return(printNumber(n,base)); }
+  size_t print(double, int=2);
+  size_t print(const IPAddress &);
+  size_t println(){ return(write("\r\n")); }
+  template<class T> size_t println(T x){ size_t n=print(x); return(n+println()); }
+  template<class T> size_t println(T x, int f){ size_t n=print(x,f); return(n+println()); }
+}; // Print
+
+class Stream : public Print{
+public:
+  virtual int available()=0;
+  virtual int read()=0;
+}; // Stream
+
+class HardwareSerial : public Stream{
+public:
+  void begin(unsigned long){}
+  void flush();
+  int available();
+  int read();
+  int availableForWrite();
+  size_t write(uint8_t);
+  size_t write(const uint8_t *, size_t);
+  using Print::write;
+  operator bool(){ return(true); }
+}; // HardwareSerial
+
+extern HardwareSerial Serial;
+
+#endif
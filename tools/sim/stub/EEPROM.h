@@ -0,0 +1,30 @@
+/**********************************************************************
+
+EEPROM.h
+COPYRIGHT (c) 2013-2016 Gregg E. Berman
+
+Part of DCC++ BASE STATION for the Arduino
+
+**********************************************************************/
+
+// HOST STAND-IN FOR THE ARDUINO EEPROM LIBRARY, KEEPING THE CONTENTS IN MEMORY FOR THE LIFE OF THE SIMULATOR
+
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include "Arduino.h"
+
+#define EEPROM_SIZE 4096
+
+struct EEPROMClass{
+  byte data[EEPROM_SIZE];
+  byte read(int a){ return(data[a]); }
+  void write(int a, byte v){ data[a]=v; }
+  void update(int a, byte v){ data[a]=v; }
+  template<class T> T &get(int a, T &t){ memcpy((void *)&t,data+a,sizeof(T)); return(t); }
+  template<class T> const T &put(int a, const T &t){ memcpy(data+a,(const void *)&t,sizeof(T)); return(t); }
+}; // EEPROMClass
+
+extern EEPROMClass EEPROM;
+
+#endif